@@ -6,14 +6,24 @@
 namespace service {}
 
 #include "service/Build.hpp"
+#include "service/BuildStream.hpp"
+#include "service/Coalescer.hpp"
+#include "service/Compression.hpp"
+#include "service/Daemon.hpp"
+#include "service/Governor.hpp"
 #include "service/Hardware.hpp"
 #include "service/Installer.hpp"
 #include "service/Job.hpp"
 #include "service/Keys.hpp"
+#include "service/MappedFile.hpp"
+#include "service/Memory.hpp"
+#include "service/Metrics.hpp"
 #include "service/Project.hpp"
 #include "service/Report.hpp"
+#include "service/Session.hpp"
 #include "service/Team.hpp"
 #include "service/Thing.hpp"
+#include "service/Timeline.hpp"
 #include "service/User.hpp"
 
 using namespace service;
@@ -11,7 +11,12 @@
 #include <sos/Link.hpp>
 #include <var/Base64.hpp>
 
+#include <deque>
+#include <memory>
+
 #include "Document.hpp"
+#include "MappedFile.hpp"
+#include "Timeline.hpp"
 
 namespace service {
 
@@ -25,6 +30,9 @@ class Build : public DocumentAccess<Build> {
   }
 
 public:
+  // image value used when the bytes are held by the Build
+  static var::StringView binary_image_marker() { return "<binary>"; }
+
   class SecretKeyInfo {
   public:
     u32 invalid_position() const { return static_cast<u32>(-1); }
@@ -34,6 +42,15 @@ public:
     API_ACCESS_FUNDAMENTAL(SecretKeyInfo, u32, size, 0);
   };
 
+  // a piece of an image that is stored once per project
+  class ChunkInfo : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(ChunkInfo);
+    // SHA-256 of the plain chunk, also the key of the chunk
+    JSON_ACCESS_STRING(ChunkInfo, hash);
+    JSON_ACCESS_INTEGER(ChunkInfo, size);
+  };
+
   class SectionImageInfo : public json::JsonKeyValue {
   public:
     explicit SectionImageInfo(const var::StringView key)
@@ -43,18 +60,53 @@ public:
       : JsonKeyValue(key, object) {}
 
     JSON_ACCESS_STRING(SectionImageInfo, image);
+    JSON_ACCESS_STRING(SectionImageInfo, hash);
+    // Compression::name() when the stored image is compressed
+    JSON_ACCESS_STRING(SectionImageInfo, compression);
+    JSON_ACCESS_INTEGER_WITH_KEY(
+      SectionImageInfo,
+      compressedSize,
+      compressed_size);
     JSON_ACCESS_INTEGER(SectionImageInfo, padding);
     JSON_ACCESS_INTEGER(SectionImageInfo, size);
     JSON_ACCESS_BOOL(SectionImageInfo, signed);
+    // set when the image is stored by another build of the project
+    JSON_ACCESS_STRING_WITH_KEY(SectionImageInfo, storagePath, storage_path);
+    JSON_ACCESS_STRING_WITH_KEY(SectionImageInfo, storageKey, storage_key);
+    JSON_ACCESS_STRING_WITH_KEY(SectionImageInfo, storageIv, storage_iv);
+    // set when the image is stored as chunks
+    JSON_ACCESS_ARRAY_WITH_KEY(
+      SectionImageInfo,
+      ChunkInfo,
+      chunkList,
+      chunk_list);
 
+    bool is_binary() const { return get_image() == binary_image_marker(); }
+
+    // binary images are held by the Build, use Build::get_section_image()
     var::Data get_image_data() const {
+      if (is_binary()) {
+        API_RETURN_VALUE_ASSIGN_ERROR(
+          var::Data(),
+          "section image is held by the build",
+          EINVAL);
+      }
+      Timeline::Span span("base64_decode", "build");
       return var::Base64().decode(var::StringView(get_image_cstring()));
     }
 
+    // binary images are signed with Build::sign()
     SectionImageInfo &sign(const crypto::Dsa &dsa) {
       if (is_signed()) {
         return *this;
       }
+      API_RETURN_VALUE_IF_ERROR(*this);
+      if (is_binary()) {
+        API_RETURN_VALUE_ASSIGN_ERROR(
+          *this,
+          "section image is held by the build",
+          EINVAL);
+      }
       const auto signed_data = sign_data(get_image_data(), dsa);
       set_image_data(signed_data);
       set_size(signed_data.size());
@@ -64,10 +116,12 @@ public:
 
     crypto::Dsa::Signature get_signature() const {
       auto data = get_image_data();
+      API_RETURN_VALUE_IF_ERROR(crypto::Dsa::Signature());
       return sos::Auth::get_signature(fs::ViewFile(data));
     }
 
     SectionImageInfo &set_image_data(var::View image_view) {
+      Timeline::Span span("base64_encode", "build");
       return set_image(var::Base64().encode(image_view).string_view());
     }
   };
@@ -79,6 +133,9 @@ public:
     JSON_ACCESS_STRING(ImageInfo, name);
     JSON_ACCESS_STRING(ImageInfo, image);
     JSON_ACCESS_STRING(ImageInfo, hash);
+    // Compression::name() when the stored image is compressed
+    JSON_ACCESS_STRING(ImageInfo, compression);
+    JSON_ACCESS_INTEGER_WITH_KEY(ImageInfo, compressedSize, compressed_size);
     JSON_ACCESS_BOOL(ImageInfo, signed);
     JSON_ACCESS_INTEGER(ImageInfo, size);
     JSON_ACCESS_INTEGER(ImageInfo, padding);
@@ -89,43 +146,83 @@ public:
       secretKeyPosition,
       secret_key_position);
     JSON_ACCESS_INTEGER_WITH_KEY(ImageInfo, secretKeySize, secret_key_size);
+    // set when the image is stored by another build of the project
+    JSON_ACCESS_STRING_WITH_KEY(ImageInfo, storagePath, storage_path);
+    JSON_ACCESS_STRING_WITH_KEY(ImageInfo, storageKey, storage_key);
+    JSON_ACCESS_STRING_WITH_KEY(ImageInfo, storageIv, storage_iv);
+    // set when the image is stored as chunks
+    JSON_ACCESS_ARRAY_WITH_KEY(ImageInfo, ChunkInfo, chunkList, chunk_list);
     JSON_ACCESS_OBJECT_LIST_WITH_KEY(
       ImageInfo,
       SectionImageInfo,
       sections,
       section_list);
 
+    bool is_binary() const { return get_image() == binary_image_marker(); }
+
+    // binary images are read from the Build that returned this
+    // object with build_image_info()
     var::Data get_image_data() const {
+      if (is_binary()) {
+        if (m_build == nullptr) {
+          API_RETURN_VALUE_ASSIGN_ERROR(
+            var::Data(),
+            "image is held by the build",
+            EINVAL);
+        }
+        return m_build->get_image(get_name());
+      }
+      Timeline::Span span("base64_decode", "build");
       return var::Base64().decode(get_image());
     }
 
+    // signed binary images are stored as base64 values
     ImageInfo &sign(const crypto::Dsa &dsa) {
       if (is_signed()) {
         return *this;
       }
-      const auto signed_data = sign_data(get_image_data(), dsa);
+      API_RETURN_VALUE_IF_ERROR(*this);
+      const auto image_data = get_image_data();
+      API_RETURN_VALUE_IF_ERROR(*this);
+      const auto signed_data = sign_data(image_data, dsa);
       set_image_data(signed_data);
       set_size(signed_data.size());
       set_signed(true);
       auto local_section_list = section_list();
       for (auto &section : local_section_list) {
-        section.sign(dsa);
+        if (section.is_binary() && m_build != nullptr) {
+          const auto signed_section_data = sign_data(
+            m_build->get_section_image(get_name(), section.key()),
+            dsa);
+          section.set_image_data(signed_section_data)
+            .set_size(signed_section_data.size())
+            .set_signed(true);
+        } else {
+          section.sign(dsa);
+        }
       }
       return *this;
     }
 
     crypto::Dsa::Signature get_signature() const {
       auto data = get_image_data();
+      API_RETURN_VALUE_IF_ERROR(crypto::Dsa::Signature());
       return sos::Auth::get_signature(fs::ViewFile(data));
     }
 
     ImageInfo &set_image_data(const var::View &image_view) {
+      Timeline::Span span("base64_encode", "build");
       return set_image(var::Base64().encode(image_view));
     }
 
     bool operator==(const ImageInfo &info) const {
       return get_name() == info.get_name();
     }
+
+  private:
+    friend class Build;
+    // set by build_image_info(), must not outlive the Build
+    const Build *m_build = nullptr;
   };
 
   class Construct {
@@ -134,9 +231,18 @@ public:
 
     API_AC(Construct, var::StringView, binary_path);
     API_AC(Construct, var::StringView, project_path);
+    // with project_id, downloads the images of the named build
     API_AC(Construct, var::StringView, build_name);
+    // with build_name, more than one service fetches the images
+    // concurrently, one transfer per service. Each service is signed in
+    // with the credentials of the Build's service.
+    API_AC(Construct, var::Vector<cloud::CloudService *>, download_service_list);
     API_AC(Construct, var::StringView, architecture);
     API_AC(Construct, var::StringView, url);
+    // reuse images from the import cache of the project
+    API_AB(Construct, import_cache, false);
+    // import the build directories of project_path on worker threads
+    API_AB(Construct, parallel_import, false);
   };
 
   Build(const Construct &options = Construct());
@@ -155,6 +261,12 @@ public:
   class ImportCompiled {
     API_ACCESS_COMPOUND(ImportCompiled, var::StringView, path);
     API_ACCESS_COMPOUND(ImportCompiled, var::StringView, build);
+    // build directories are imported on worker threads, except at the
+    // debug level where the loader output would interleave
+    API_ACCESS_BOOL(ImportCompiled, parallel, false);
+    API_ACCESS_FUNDAMENTAL(ImportCompiled, u32, thread_count, 4);
+    // keeps processed images in `<path>/.sl_import_cache`
+    API_ACCESS_BOOL(ImportCompiled, cache, false);
 
   public:
   };
@@ -218,8 +330,10 @@ public:
   }
 
   ImageInfo build_image_info(const var::StringView build_name) const {
-    return build_image_list().find(
+    ImageInfo result = build_image_list().find(
       ImageInfo().set_name(normalize_name(build_name).cstring()));
+    result.m_build = this;
+    return result;
   }
 
   Build &insert_secret_key(
@@ -241,8 +355,69 @@ public:
   Build &import_url(const var::StringView url);
   // int download(const BuildOptions &options);
 
+  /*!
+   * Images imported by the Build are kept as raw bytes. The
+   * JSON value of the image is `binary_image_marker()` and
+   * the bytes are only base64 encoded when the build is
+   * exported or saved. Printing the Build shows the marker,
+   * call encode_binary_images() first to print base64 values.
+   *
+   * ImageInfo objects returned by build_image_info() read binary
+   * images through the Build. ImageInfo and SectionImageInfo
+   * objects taken from build_image_list() or section_list()
+   * don't know the Build, get_image_data() and sign() set
+   * EINVAL for binary images. Use these methods instead.
+   *
+   * Base64 values are decoded on first read and cached by the
+   * Build. The JSON is not modified, so copies of the Build
+   * and ImageInfo objects still see the base64 value.
+   *
+   */
   var::Data get_image(const var::StringView name) const;
-  Build &set_image(const var::StringView name, const var::Data &image);
+  Build &set_image(const var::StringView name, const var::View image);
+
+  // base64 images are decoded once, the view is valid until the image
+  // changes (reading other images doesn't move it)
+  var::View get_image_view(const var::StringView name) const;
+
+  var::Data get_section_image(
+    const var::StringView name,
+    const var::StringView section) const;
+  var::View get_section_image_view(
+    const var::StringView name,
+    const var::StringView section) const;
+  Build &set_section_image(
+    const var::StringView name,
+    const var::StringView section,
+    const var::View image);
+
+  // replaces binary images with base64 values in the JSON
+  Build &encode_binary_images();
+
+  /*!
+   * A bundle is a binary export of the build. A header and a
+   * JSON manifest are followed by the raw images and sections,
+   * each starting on a page boundary. import_bundle() maps the
+   * file and the images are views of the mapping rather than
+   * copies. The mapping is shared by copies of the Build.
+   *
+   */
+  static var::StringView bundle_suffix() { return "slb"; }
+  Build &export_bundle(const fs::File &file);
+  Build &import_bundle(const var::StringView path);
+  // the mapped bundle, empty if the build wasn't imported from one
+  var::View get_bundle_view() const {
+    return m_bundle_file ? m_bundle_file->view() : var::View();
+  }
+
+  /*!
+   * Images that have the same hash as an image stored by `build`
+   * refer to the storage object of `build`. `save()` doesn't
+   * upload them again. `build` must be a saved build of the same
+   * project.
+   *
+   */
+  Build &reuse_storage(const Build &build);
 
   var::NameString normalize_name(const var::StringView build_name) const;
   var::NameString normalize_elf_name(
@@ -272,13 +447,95 @@ public:
     return get_arch(name);
   }
 
+  /*!
+   * When set, save() splits images into content-defined chunks
+   * that are stored once per project under
+   * `builds/<project id>/chunks`. The chunk manifest of each
+   * image is saved in its ImageInfo. Chunks that a build passed
+   * to reuse_storage() already has are not uploaded.
+   *
+   * Downloads fetch each distinct chunk of an image once, in
+   * order, over the storage connection of the cloud service.
+   *
+   */
+  API_AB(Build, chunk_storage, false);
+
+  // images are compressed before they are encrypted, chunks are not
+  API_AB(Build, compressed_storage, false);
 
 protected:
   void interface_save() override;
   void interface_remove() override;
+  void interface_export_file(const fs::File &file) const override;
 
 private:
+  class BinaryImage {
+  public:
+    var::View get_view() const {
+      return is_mapped() ? view() : var::View(data());
+    }
+
+  private:
+    API_AC(BinaryImage, var::NameString, name);
+    API_AC(BinaryImage, var::Data, data);
+    // the base64 value that was decoded, held so it can be compared
+    API_AC(BinaryImage, json::JsonValue, source);
+    // set instead of data when the bytes are in a mapped bundle
+    API_AC(BinaryImage, var::View, view);
+    API_AB(BinaryImage, mapped, false);
+  };
+
   var::KeyString m_application_architecture;
+  // decoded base64 images are cached here by const accessors, a deque
+  // keeps views of earlier images valid when an image is added
+  mutable std::deque<BinaryImage> m_binary_image_list;
+  // mapped images from import_bundle() point into this file
+  std::shared_ptr<MappedFile> m_bundle_file;
+
+  class ElfImage {
+    API_AC(ElfImage, ImageInfo, info);
+    API_AC(ElfImage, var::Data, image);
+    API_AC(ElfImage, var::Vector<BinaryImage>, section_image_list);
+  };
+
+  class ImportCacheEntry : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(ImportCacheEntry);
+    JSON_ACCESS_INTEGER_WITH_KEY(ImportCacheEntry, elfSize, elf_size);
+    JSON_ACCESS_INTEGER_WITH_KEY(ImportCacheEntry, elfModified, elf_modified);
+    JSON_ACCESS_STRING_WITH_KEY(ImportCacheEntry, elfHash, elf_hash);
+    JSON_ACCESS_STRING_WITH_KEY(ImportCacheEntry, settingsHash, settings_hash);
+
+    ImageInfo get_image_info() const {
+      return ImageInfo(to_object().at("imageInfo").to_object());
+    }
+
+    ImportCacheEntry &set_image_info(const ImageInfo &image_info) {
+      to_object().insert("imageInfo", image_info);
+      return *this;
+    }
+  };
+
+  static var::StringView import_cache_directory() {
+    return ".sl_import_cache";
+  }
+
+  var::NameString get_binary_image_name(
+    const var::StringView name,
+    const var::StringView section) const;
+  const BinaryImage *find_binary_image(const var::StringView name) const;
+  // call with the binary image mutex held
+  BinaryImage &get_binary_image_entry(const var::StringView name) const;
+  void
+  store_binary_image(const var::StringView name, const var::View image) const;
+  void store_mapped_image(const var::StringView name, const var::View image);
+  const BinaryImage *load_binary_image(
+    const var::StringView name,
+    const var::StringView section) const;
+  template <class Info>
+  const BinaryImage *
+  decode_binary_image(const var::StringView binary_name, Info &info) const;
+  json::JsonObject get_encoded_object() const;
 
   Document::Path create_storage_path(const var::StringView build_name) const {
     return Document::Path("builds") / get_project_id() / id()
@@ -294,9 +551,56 @@ private:
     API_AC(ImportElfFile, var::StringView, build_name);
   };
 
-  ImageInfo import_elf_file(const var::StringView path);
+  ImageInfo
+  import_elf_file(const var::StringView path, const var::StringView name);
+  // imports a single ELF such as `<project>/build_<name>/<project>_<name>.elf`
+  Build &
+  import_elf_binary(const var::StringView path, const var::StringView build_name);
+  void apply_application_attributes(
+    var::Data &image,
+    const var::StringView name,
+    const var::StringView id,
+    u16 version);
+  // reads the ELF without changing the build so it can run on any thread
+  ElfImage load_elf_file(const var::StringView path);
+  ImageInfo
+  store_elf_image(const var::StringView name, const ElfImage &elf_image);
+
+  bool load_import_cache(
+    const var::StringView cache_path,
+    const var::StringView elf_path,
+    const var::StringView settings_hash,
+    ElfImage &elf_image);
+  void save_import_cache(
+    const var::StringView cache_path,
+    const var::StringView elf_path,
+    const var::StringView settings_hash,
+    const ElfImage &elf_image);
+  static ImportCacheEntry get_elf_file_entry(const var::StringView elf_path);
+
+  class StorageObject {
+    API_AC(StorageObject, var::String, hash);
+    API_AC(StorageObject, var::String, path);
+    API_AC(StorageObject, var::String, key);
+    API_AC(StorageObject, var::String, iv);
+    API_AC(StorageObject, var::String, compression);
+    API_AF(StorageObject, u32, compressed_size, 0);
+  };
+
+  // hashes the current images, references to changed images are removed
+  Build &update_image_hashes();
+  template <class Info>
+  void update_image_hash(Info &info, const var::View image) const;
+  var::Vector<StorageObject> get_storage_object_list() const;
+
+  // chunks known to be stored for the project
+  var::Vector<var::String> m_stored_chunk_list;
+
+  Document::Path create_chunk_storage_path(const var::StringView hash) const;
+  template <class Info> void add_stored_chunks(const Info &info);
 
-  var::String calculate_hash(var::Data &image);
+  // SHA-256 of the plain image as a hex string
+  static var::String calculate_hash(const var::View image);
   void migrate_build_info_list_20200518();
 
   static var::StringView get_arch(const var::StringView name);
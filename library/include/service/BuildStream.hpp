@@ -0,0 +1,185 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_BUILD_STREAM_HPP
+#define SERVICE_API_SERVICE_BUILD_STREAM_HPP
+
+#include <crypto/Aes.hpp>
+#include <crypto/Sha256.hpp>
+#include <var/Array.hpp>
+#include <var/Data.hpp>
+#include <var/StackString.hpp>
+#include <var/String.hpp>
+#include <var/Vector.hpp>
+#include <var/View.hpp>
+
+namespace service {
+
+/*!
+ * \brief Decrypt Stream class
+ * \details The DecryptStream class decrypts AES-CBC ciphertext
+ * as it is written and keeps a running SHA-256 of the plain
+ * image. Whole blocks are decrypted right away, only a partial
+ * block waits for the next write. The zero padding after
+ * `size` bytes is dropped. Images without a key are copied
+ * and hashed.
+ *
+ * ```cpp
+ * var::Data image;
+ * DecryptStream decrypt_stream(image, size, key, iv);
+ * fs::LambdaFile image_file;
+ * image_file.set_write_callback(
+ *   [&](int location, const var::View view) -> int {
+ *     return decrypt_stream.write(location, view);
+ *   });
+ * ```
+ *
+ */
+class DecryptStream {
+public:
+  DecryptStream(
+    var::Data &image,
+    size_t size,
+    const var::StringView key,
+    const var::StringView initialization_vector);
+
+  // writes must be in order
+  int write(int location, const var::View cipher);
+
+  // SHA-256 of the plain image written so far
+  var::GeneralString get_hash();
+
+private:
+  static constexpr size_t chunk_size = 1024;
+
+  var::Data &m_image;
+  size_t m_size;
+  bool m_is_encrypted;
+  crypto::Aes::Key m_key;
+  var::Array<u8, 16> m_initialization_vector;
+  var::Array<u8, chunk_size> m_chunk;
+  size_t m_chunk_count = 0;
+  size_t m_location = 0;
+  crypto::Sha256 m_sha256;
+
+  void append(const var::View plain);
+  bool decrypt(size_t cipher_size);
+};
+
+/*!
+ * \brief Encrypt Stream class
+ * \details The EncryptStream class encrypts an image with
+ * AES-CBC while it is read. The ciphertext goes through a
+ * fixed ring so an upload holds one ring of memory no
+ * matter how large the image is. Each chunk is encrypted
+ * with the last ciphertext block of the previous chunk as
+ * its IV, which is the same as encrypting the zero padded
+ * image in one pass.
+ *
+ * ```cpp
+ * EncryptStream encrypt_stream(image, key);
+ * fs::LambdaFile encrypted_file;
+ * encrypted_file.set_size(encrypt_stream.size())
+ *   .set_read_callback([&](int location, var::View view) -> int {
+ *     return encrypt_stream.read(location, view);
+ *   });
+ * ```
+ *
+ */
+class EncryptStream {
+public:
+  EncryptStream(const var::View image, const crypto::Aes::Key &key);
+
+  // ciphertext size, the image is zero padded to the AES block size
+  size_t size() const {
+    return m_image.size() + crypto::Aes::get_padding(m_image.size());
+  }
+
+  // reads must be in order, a read at location 0 starts over
+  int read(int location, var::View destination);
+
+private:
+  static constexpr size_t chunk_size = 1024;
+  static constexpr size_t ring_size = chunk_size * 4;
+
+  var::View m_image;
+  crypto::Aes::Key m_key;
+  var::Array<u8, 16> m_initialization_vector;
+  var::Array<u8, ring_size> m_ring;
+  var::Array<u8, chunk_size> m_chunk;
+  size_t m_ring_head = 0;
+  size_t m_ring_count = 0;
+  size_t m_image_offset = 0;
+  size_t m_location = 0;
+
+  void restart();
+  // encrypts chunks until the ring is full or the image is done
+  size_t fill();
+};
+
+/*!
+ * \brief Image Field Stream class
+ * \details The ImageFieldStream class copies build JSON as it
+ * is written but decodes the value of every `"image"` key
+ * straight into a binary buffer. The JSON keeps a placeholder
+ * for each decoded image so the text that is parsed at the
+ * end is only the metadata. Empty values and values such as
+ * `<base64>` are kept as they are. Base64 values can escape
+ * `/` as `\/` and be wrapped with escaped line breaks.
+ *
+ * ```cpp
+ * ImageFieldStream image_field_stream;
+ * fs::LambdaFile response;
+ * response.set_write_callback(
+ *   [&](int location, const var::View view) -> int {
+ *     return image_field_stream.write(location, view);
+ *   });
+ * ```
+ *
+ */
+class ImageFieldStream {
+public:
+  // writes must be in order
+  int write(int location, const var::View view);
+
+  bool is_complete() const { return m_state == State::json; }
+  // set when an image value isn't base64
+  bool is_invalid() const { return m_is_invalid; }
+  const var::String &json() const { return m_json; }
+  var::Vector<var::Data> &image_list() { return m_image_list; }
+
+  // the value that replaces the image at `offset` in image_list()
+  static var::KeyString get_placeholder(size_t offset);
+
+private:
+  enum class State {
+    json,
+    string,
+    string_escape,
+    image_start,
+    image,
+    image_escape
+  };
+
+  // base64 is decoded in groups of four characters
+  static constexpr size_t decode_size = 4096;
+  static constexpr size_t key_size = 16;
+
+  State m_state = State::json;
+  size_t m_location = 0;
+  var::String m_json;
+  // only short strings are kept, they are compared with `image`
+  var::KeyString m_string;
+  bool m_is_key_image = false;
+  bool m_is_image_value = false;
+  bool m_is_invalid = false;
+  var::String m_base64;
+  var::Vector<var::Data> m_image_list;
+
+  void append_json(char c) { m_json.append(var::StringView(&c, 1)); }
+  bool write_character(char c);
+  bool decode(size_t size);
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_BUILD_STREAM_HPP
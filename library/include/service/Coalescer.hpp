@@ -0,0 +1,136 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_COALESCER_HPP
+#define SERVICE_API_SERVICE_COALESCER_HPP
+
+#include <chrono/ClockTimer.hpp>
+#include <thread/Mutex.hpp>
+#include <var/Vector.hpp>
+
+#include "Document.hpp"
+#include "Metrics.hpp"
+
+namespace service {
+
+/*!
+ * \brief Coalescer class
+ * \details The Coalescer class merges frequent updates
+ * to the same document. The first update to a document
+ * starts a window. When the window expires, the fields
+ * that changed are written with one patch. Fields that were
+ * removed from the document are removed from the cloud
+ * document.
+ *
+ * A write that fails stays pending and is tried again with
+ * the next flush. The error doesn't stop other writes, it is
+ * counted in the statistics.
+ *
+ * The first write of a document that already exists reads the
+ * cloud document once, so fields that were removed locally are
+ * removed from the cloud as well. Writes are made without
+ * holding the lock that `update()` takes.
+ *
+ * ```cpp
+ * Coalescer coalescer(Coalescer::Construct().set_window(1_seconds));
+ * while (is_running) {
+ *   coalescer.update(thing.set_system_information(info));
+ * }
+ * // the destructor flushes anything that is pending
+ * ```
+ *
+ * `flush_if_due()` is also called by `update()`. A caller that
+ * stops updating should call `flush_if_due()` or `flush()`
+ * periodically.
+ *
+ */
+class Coalescer : public cloud::CloudAccess, public Metrics::Source {
+public:
+  class Construct {
+  public:
+    Construct() { set_window(1_seconds); }
+
+  private:
+    API_AC(Construct, chrono::MicroTime, window);
+    API_AC(Construct, var::StringView, name);
+  };
+
+  class Statistics : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(Statistics);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, windowMs, window);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, pendingCount, pending_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, updateCount, update_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, writeCount, write_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(
+      Statistics,
+      writesAvoidedCount,
+      writes_avoided_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, errorCount, error_count);
+  };
+
+  explicit Coalescer(const Construct &options = Construct());
+  ~Coalescer();
+
+  Coalescer(const Coalescer &) = delete;
+  Coalescer &operator=(const Coalescer &) = delete;
+
+  // queues the current fields of the document
+  Coalescer &update(const Document &document);
+
+  // writes documents with an expired window
+  Coalescer &flush_if_due();
+
+  // writes all pending documents
+  Coalescer &flush();
+
+  Statistics get_statistics() const;
+  json::JsonObject get_metrics() const override {
+    return get_statistics().to_object();
+  }
+
+private:
+  class Entry {
+  public:
+    bool operator==(const Entry &a) const {
+      return path() == a.path() && id() == a.id();
+    }
+
+    bool is_pending() const {
+      return pending().is_empty() == false || removed_list().count() > 0;
+    }
+
+  private:
+    API_AC(Entry, Document::Path, path);
+    API_AC(Entry, Document::Id, id);
+    // fields waiting to be written
+    API_AC(Entry, json::JsonObject, pending);
+    // written fields that are no longer in the document
+    API_AC(Entry, var::Vector<var::KeyString>, removed_list);
+    // fields as they were last written
+    API_AC(Entry, json::JsonObject, written);
+    // milliseconds on the coalescer clock when the window started
+    API_AF(Entry, u32, first_update, 0);
+    API_AB(Entry, existing, false);
+    // written holds the fields of the cloud document
+    API_AB(Entry, seeded, false);
+  };
+
+  mutable thread::Mutex m_mutex;
+  // held while writing, update() only waits for m_mutex
+  thread::Mutex m_write_mutex;
+  chrono::MicroTime m_window;
+  chrono::ClockTimer m_clock;
+  var::Vector<Entry> m_entry_list;
+  u32 m_update_count = 0;
+  u32 m_write_count = 0;
+  u32 m_error_count = 0;
+  bool m_is_writing = false;
+
+  Coalescer &write_entries(bool is_due_only);
+  bool write(Entry &entry);
+  static bool is_equal(const json::JsonValue &a, const json::JsonValue &b);
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_COALESCER_HPP
@@ -0,0 +1,50 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_COMPRESSION_HPP
+#define SERVICE_API_SERVICE_COMPRESSION_HPP
+
+#include <api/api.hpp>
+#include <var/Data.hpp>
+#include <var/StringView.hpp>
+#include <var/View.hpp>
+
+namespace service {
+
+/*!
+ * \brief Compression class
+ * \details The Compression class is a small LZ77 codec in
+ * the style of an LZ4 block. Firmware images have long runs
+ * of padding and repeated instruction sequences, so this
+ * saves a good part of the upload without a dependency.
+ *
+ * Each sequence is a token (literal count in the high
+ * nibble, match length minus four in the low nibble), the
+ * extra length bytes, the literals, and a two byte little
+ * endian offset. The last sequence only has literals.
+ *
+ * ```cpp
+ * const var::Data compressed = Compression().compress(image);
+ * const var::Data image_copy
+ *   = Compression().decompress(compressed, image.size());
+ * ```
+ *
+ */
+class Compression : public api::ExecutionContext {
+public:
+  // value stored in ImageInfo::compression
+  static var::StringView name() { return "lz"; }
+
+  var::Data compress(const var::View input) const;
+
+  // `size` is the size of the original data
+  var::Data decompress(const var::View input, size_t size) const;
+
+private:
+  static constexpr size_t minimum_match = 4;
+  static constexpr size_t maximum_offset = 65535;
+  static constexpr size_t hash_bits = 12;
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_COMPRESSION_HPP
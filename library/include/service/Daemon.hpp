@@ -0,0 +1,157 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_DAEMON_HPP
+#define SERVICE_API_SERVICE_DAEMON_HPP
+
+#include <chrono/MicroTime.hpp>
+#include <cloud/CloudObject.hpp>
+#include <json/Json.hpp>
+#include <sos/Link.hpp>
+#include <var/StackString.hpp>
+#include <var/Vector.hpp>
+
+#include "Document.hpp"
+#include "Metrics.hpp"
+
+namespace service {
+
+/*!
+ * \brief Daemon class
+ * \details The Daemon class keeps the cloud session, a
+ * document cache and the link connection alive between
+ * invocations of a command line tool. Requests arrive
+ * as JSON objects on a Unix domain socket:
+ *
+ * ```json
+ * {"command": "install", "options": {"projectPath": "HelloWorld"}}
+ * ```
+ *
+ * The supported commands are `install`, `saveBuild`, `getDocument`,
+ * `saveDocument`, `statistics` and `stop`.
+ *
+ * Each message is a four byte big endian length followed by the
+ * JSON. Daemon::Client is the thin side that forwards a request
+ * and waits for the response.
+ *
+ * The socket is in a directory that only the owner can open
+ * (`/tmp/sl_service-<uid>` by default) and requests from other
+ * users are rejected. The requests carry the owner's cloud
+ * session and signing keys. A running daemon keeps its socket, a
+ * second daemon on the same path fails with EADDRINUSE.
+ *
+ * Cached documents expire after `cache_lifetime`. Saves and
+ * installs invalidate them.
+ *
+ * The daemon is only available on the host (`__link`) for POSIX
+ * systems.
+ *
+ */
+class Daemon : public cloud::CloudObject, public Metrics::Source {
+public:
+  class Construct {
+  public:
+    Construct() {
+      set_cache_lifetime(60_seconds);
+      set_request_timeout(5_seconds);
+    }
+
+  private:
+    API_AC(Construct, var::StringView, path);
+    API_AF(Construct, sos::Link *, connection, nullptr);
+    API_AF(Construct, u32, maximum_cache_count, 256);
+    API_AC(Construct, chrono::MicroTime, cache_lifetime);
+    // a client that doesn't send its request in time is dropped
+    API_AC(Construct, chrono::MicroTime, request_timeout);
+  };
+
+  class Statistics : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(Statistics);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, requestCount, request_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, cacheCount, cache_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, cacheHitCount, cache_hit_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, cacheMissCount, cache_miss_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(
+      Statistics,
+      cacheEvictionCount,
+      cache_eviction_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Statistics, rejectedCount, rejected_count);
+  };
+
+  class Client : public api::ExecutionContext {
+  public:
+    explicit Client(const var::StringView path) : m_path(path) {}
+
+    // returns the response object sent by the daemon
+    json::JsonObject
+    request(const var::StringView command, const json::JsonObject &options);
+
+    bool is_running();
+
+  private:
+    var::PathString m_path;
+  };
+
+  explicit Daemon(const Construct &options);
+  ~Daemon();
+
+  Daemon(const Daemon &) = delete;
+  Daemon &operator=(const Daemon &) = delete;
+
+  // the socket in a directory that only the current user can open
+  static var::PathString default_path();
+
+  // serves requests until a `stop` command is received
+  Daemon &run();
+
+  Statistics get_statistics() const;
+  json::JsonObject get_metrics() const override {
+    return get_statistics().to_object();
+  }
+
+private:
+  class CacheEntry {
+  public:
+    CacheEntry() {}
+    CacheEntry(const var::StringView path, const json::JsonObject &object)
+      : m_path(path), m_object(object) {}
+
+    bool operator==(const CacheEntry &a) const { return m_path == a.m_path; }
+
+  private:
+    API_AC(CacheEntry, Document::Path, path);
+    API_AC(CacheEntry, json::JsonObject, object);
+    API_AF(CacheEntry, u32, expires_at, 0);
+  };
+
+  var::PathString m_path;
+  sos::Link *m_connection;
+  u32 m_maximum_cache_count;
+  chrono::MicroTime m_cache_lifetime;
+  chrono::MicroTime m_request_timeout;
+  int m_socket = -1;
+  bool m_is_bound = false;
+  bool m_is_stop = false;
+  var::Vector<CacheEntry> m_cache;
+  u32 m_request_count = 0;
+  u32 m_cache_hit_count = 0;
+  u32 m_cache_miss_count = 0;
+  u32 m_cache_eviction_count = 0;
+  u32 m_rejected_count = 0;
+
+  json::JsonObject process_request(const json::JsonObject &request);
+
+  json::JsonObject install(const json::JsonObject &options);
+  json::JsonObject save_build(const json::JsonObject &options);
+  json::JsonObject get_document(const json::JsonObject &options);
+  json::JsonObject save_document(const json::JsonObject &options);
+
+  json::JsonObject get_cached(const var::StringView path);
+  void update_cache(const var::StringView path, const json::JsonObject &object);
+  void remove_cached(const var::StringView path);
+  void clear_cache() { m_cache.clear(); }
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_DAEMON_HPP
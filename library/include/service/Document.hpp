@@ -3,6 +3,8 @@
 #ifndef CLOUD_API_CLOUD_DOCUMENT_HPP
 #define CLOUD_API_CLOUD_DOCUMENT_HPP
 
+#include <cerrno>
+
 #include <cloud/CloudAccess.hpp>
 #include <crypto/Random.hpp>
 #include <json/Json.hpp>
@@ -10,6 +12,8 @@
 #include <var/StackString.hpp>
 #include <var/String.hpp>
 
+#include "Trace.hpp"
+
 namespace service {
 
 class Document : public cloud::CloudAccess, public json::JsonObject {
@@ -57,6 +61,26 @@ public:
     API_AC(Tag, var::KeyString, value);
   };
 
+  using Timestamp = var::KeyString;
+
+  /*!
+   * \brief Conflict class
+   * \details A Conflict is recorded when a conditional save
+   * finds that the document was modified after it was loaded.
+   * The snapshot is the latest version of the document.
+   */
+  class Conflict {
+  public:
+    bool is_valid() const { return snapshot().is_empty() == false; }
+
+  private:
+    API_AC(Conflict, json::JsonObject, snapshot);
+    API_AC(Conflict, Timestamp, update_time);
+  };
+
+  // error number assigned when a conditional save conflicts
+  static int conflict_error_number() { return ESTALE; }
+
   static bool is_permissions_valid(var::StringView value) {
     if (value == "public" || value == "private" || value == "searchable") {
       return true;
@@ -88,6 +112,16 @@ public:
   bool is_existing() const { return m_is_existing; }
   bool is_imported() const { return m_is_imported; }
 
+  // update time of the cloud document when it was loaded, cleared by a save
+  // because the store doesn't return the saved document
+  const Timestamp &update_time() const { return m_update_time; }
+
+  bool is_conflict() const { return m_conflict.is_valid(); }
+  const Conflict &conflict() const { return m_conflict; }
+
+  // replace the local contents with the conflict snapshot
+  Document &refresh_from_conflict();
+
 protected:
   Document &
   import_binary_file_to_base64(var::StringView path, const var::StringView key);
@@ -97,9 +131,10 @@ protected:
     const var::StringView key) const;
 
   void interface_import_file(const fs::File &file);
-  void interface_export_file(const fs::File &file) const;
+  virtual void interface_export_file(const fs::File &file) const;
   virtual void interface_save();
   virtual void interface_remove();
+  virtual void interface_save_if_unchanged();
 
 protected:
   void set_id(const var::StringView id) { m_id = id; }
@@ -109,6 +144,9 @@ private:
   Id m_id;
   bool m_is_existing = false;
   bool m_is_imported = true;
+  bool m_is_precondition = false;
+  Timestamp m_update_time;
+  Conflict m_conflict;
 
   Path get_path_with_id() const {
     return Path(path()).append("/").append(id());
@@ -130,6 +168,10 @@ private:
   list(var::StringView path, var::StringView mask);
 
   void update_is_existing();
+  bool is_precondition_failed();
+  json::JsonObject
+  read_document(const var::StringView path, Timestamp &update_time);
+  void load_conflict();
 };
 
 template <class Derived> class DocumentAccess : public Document {
@@ -152,6 +194,19 @@ public:
     return static_cast<Derived &>(*this);
   }
 
+  // saves only if the cloud document is unchanged since it was loaded,
+  // the document must be loaded from the cloud (not imported from a
+  // file) or refreshed from a conflict. Load it again after a save.
+  Derived &save_if_unchanged() {
+    interface_save_if_unchanged();
+    return static_cast<Derived &>(*this);
+  }
+
+  Derived &refresh_from_conflict() {
+    Document::refresh_from_conflict();
+    return static_cast<Derived &>(*this);
+  }
+
   Derived &set_id(const var::StringView id) {
     Document::set_id(id);
     return static_cast<Derived &>(*this);
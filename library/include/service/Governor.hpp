@@ -0,0 +1,141 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_GOVERNOR_HPP
+#define SERVICE_API_SERVICE_GOVERNOR_HPP
+
+#include <api/api.hpp>
+#include <chrono/ClockTimer.hpp>
+#include <chrono/ClockTime.hpp>
+#include <chrono/MicroTime.hpp>
+#include <thread/Cond.hpp>
+#include <thread/Mutex.hpp>
+
+#include "Metrics.hpp"
+
+namespace service {
+
+/*!
+ * \brief Governor class
+ * \details The Governor paces requests to the cloud backend.
+ * A token bucket limits the request rate and an
+ * additive-increase/multiplicative-decrease (AIMD)
+ * window limits the number of requests in flight.
+ *
+ * The window grows by one request per window of
+ * successful requests and is halved when a request
+ * is slower than the latency target or fails with
+ * an error that indicates the backend is overloaded.
+ *
+ * Every cloud call made by ServiceAPI is wrapped in
+ * a Governor::Request. A Request that is nested in
+ * another Request on the same thread and the same Governor
+ * doesn't wait, it is part of the outer request. A Request
+ * on a different Governor waits for that Governor. Long-lived calls such as
+ * listeners use `Request::Type::stream`: they take a token
+ * but don't hold a place in the window.
+ *
+ * ```cpp
+ * {
+ *   Governor::Request request;
+ *   cloud_service().store().get_document(path);
+ * }
+ * ```
+ *
+ */
+class Governor : public api::ExecutionContext, public Metrics::Source {
+public:
+  class Limits {
+  public:
+    Limits() { set_latency_target(2_seconds); }
+
+  private:
+    // tokens added to the bucket per second
+    API_AF(Limits, u32, rate, 20);
+    // maximum tokens the bucket can hold
+    API_AF(Limits, u32, burst, 40);
+    API_AF(Limits, u32, minimum_window, 1);
+    API_AF(Limits, u32, maximum_window, 16);
+    API_AC(Limits, chrono::MicroTime, latency_target);
+  };
+
+  class Status : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(Status);
+    JSON_ACCESS_INTEGER(Status, rate);
+    JSON_ACCESS_INTEGER(Status, burst);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, minimumWindow, minimum_window);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, maximumWindow, maximum_window);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, latencyTargetMs, latency_target);
+    JSON_ACCESS_INTEGER(Status, window);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, inFlight, in_flight);
+    JSON_ACCESS_INTEGER(Status, tokens);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, requestCount, request_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, congestionCount, congestion_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, throttleCount, throttle_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Status, averageLatencyMs, average_latency);
+  };
+
+  class Request {
+  public:
+    enum class Type { request, stream };
+
+    explicit Request(
+      Governor &governor = Governor::default_governor(),
+      Type type = Type::request);
+    explicit Request(Type type)
+      : Request(Governor::default_governor(), type) {}
+    ~Request();
+
+    Request(const Request &) = delete;
+    Request &operator=(const Request &) = delete;
+
+  private:
+    Governor &m_governor;
+    chrono::ClockTimer m_timer;
+    Type m_type;
+    bool m_is_nested;
+    bool m_is_error_on_entry;
+  };
+
+  explicit Governor(const var::StringView name = "governor");
+
+  static Governor &default_governor();
+
+  Governor &set_limits(const Limits &limits);
+  Limits limits() const;
+
+  Status get_status() const;
+  json::JsonObject get_metrics() const override {
+    return get_status().to_object();
+  }
+
+  // errors that indicate the backend is shedding load
+  static bool is_congestion_error(int error_number);
+
+private:
+  mutable thread::Mutex m_mutex;
+  // signaled when a request leaves the window or the limits change
+  thread::Cond m_cond = thread::Cond(m_mutex);
+  Limits m_limits;
+  // microseconds of the last refill
+  u64 m_refill_time = 0;
+  float m_tokens;
+  float m_window;
+  u32 m_in_flight = 0;
+  u32 m_request_count = 0;
+  u32 m_congestion_count = 0;
+  u32 m_throttle_count = 0;
+  u64 m_total_latency = 0;
+
+  void acquire(Request::Type type);
+  void release(
+    Request::Type type,
+    const chrono::MicroTime &latency,
+    bool is_congested);
+  void refill();
+  void decrease_window();
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_GOVERNOR_HPP
@@ -64,6 +64,8 @@ public:
     // OS options
     API_ACCESS_BOOL(Install, verify, false);
     API_ACCESS_BOOL(Install, append_hash, false);
+    // import the build directories of project_path on worker threads
+    API_ACCESS_BOOL(Install, parallel_import, false);
     API_ACCESS_BOOL(Install, reconnect, false);
     API_ACCESS_COMPOUND(Install, chrono::MicroTime, delay);
     API_ACCESS_FUNDAMENTAL(Install, u32, retry_reconnect_count, 50);
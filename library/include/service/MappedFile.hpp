@@ -0,0 +1,59 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_MAPPED_FILE_HPP
+#define SERVICE_API_SERVICE_MAPPED_FILE_HPP
+
+#include <api/api.hpp>
+#include <var/Data.hpp>
+#include <var/StringView.hpp>
+#include <var/View.hpp>
+
+#if defined __link && !defined __win32
+#define MAPPED_FILE_IS_MMAP 1
+#else
+#define MAPPED_FILE_IS_MMAP 0
+#endif
+
+namespace service {
+
+/*!
+ * \brief Mapped File class
+ * \details The MappedFile class maps a file read-only
+ * into memory so that parts of it can be used as views
+ * without seeking and copying through fs::File.
+ *
+ * Where `mmap()` isn't available, the file is read
+ * into memory instead.
+ *
+ * ```cpp
+ * MappedFile elf_file("app.elf");
+ * const var::View header = elf_file.view().truncate(52);
+ * ```
+ *
+ */
+class MappedFile : public api::ExecutionContext {
+public:
+  explicit MappedFile(const var::StringView path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  var::View view() const { return m_view; }
+  size_t size() const { return m_view.size(); }
+
+  // bytes at `offset` or an empty view if they are out of range
+  var::View get_view(size_t offset, size_t size) const;
+
+private:
+  var::View m_view;
+#if MAPPED_FILE_IS_MMAP
+  void *m_mapping = nullptr;
+#else
+  var::Data m_data;
+#endif
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_MAPPED_FILE_HPP
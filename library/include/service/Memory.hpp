@@ -0,0 +1,101 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_MEMORY_HPP
+#define SERVICE_API_SERVICE_MEMORY_HPP
+
+#include <cloud/CloudObject.hpp>
+#include <json/Json.hpp>
+#include <thread/Mutex.hpp>
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+
+/*!
+ * Configuring with `SERVICE_API_IS_MEMORY_PROFILE=ON` replaces the
+ * global `operator new` and `operator delete` so heap usage can
+ * be measured. Without it, Memory::Operation records nothing.
+ *
+ */
+namespace service {
+
+/*!
+ * \brief Memory class
+ * \details The Memory class records the heap high-water
+ * mark and the number of allocations for each top-level
+ * operation (import, save, install, publish).
+ *
+ * ```cpp
+ * {
+ *   Memory::Operation operation("import");
+ *   build.import_compiled(options);
+ * }
+ * printer().object("memory", Metrics::get_metrics("memory"));
+ * ```
+ *
+ * Each operation tracks its own peak, so nested operations
+ * and operations on other threads don't reset each other.
+ * The heap is process-wide: an operation's peak includes
+ * memory that other threads allocate while it runs. Up to
+ * 16 operations are tracked at once, more report a peak
+ * of zero. JSON values are counted through
+ * `json_set_alloc_funcs()`. Other memory allocated with
+ * `malloc()` directly is not counted.
+ *
+ */
+class Memory : public Metrics::Source {
+public:
+  class Usage : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(Usage);
+    JSON_ACCESS_INTEGER(Usage, count);
+    JSON_ACCESS_INTEGER_WITH_KEY(Usage, peakBytes, peak_bytes);
+    JSON_ACCESS_INTEGER_WITH_KEY(Usage, lastPeakBytes, last_peak_bytes);
+    JSON_ACCESS_INTEGER_WITH_KEY(Usage, allocationCount, allocation_count);
+    JSON_ACCESS_INTEGER_WITH_KEY(
+      Usage,
+      lastAllocationCount,
+      last_allocation_count);
+  };
+
+  class Operation : public cloud::CloudAccess {
+  public:
+    explicit Operation(const char *name);
+    ~Operation();
+
+    Operation(const Operation &) = delete;
+    Operation &operator=(const Operation &) = delete;
+
+    // bytes above the starting heap size
+    size_t peak_bytes() const;
+    size_t allocation_count() const;
+
+  private:
+    const char *m_name;
+    size_t m_start_bytes;
+    size_t m_start_allocation_count;
+    size_t m_slot;
+  };
+
+  static bool is_enabled() { return SERVICE_API_IS_MEMORY_PROFILE; }
+
+  // bytes currently allocated with operator new
+  static size_t current_bytes();
+  static size_t peak_bytes();
+  static size_t allocation_count();
+
+  static Memory &instance();
+
+  json::JsonObject get_metrics() const override;
+
+private:
+  Memory() : Metrics::Source("memory") {}
+
+  mutable thread::Mutex m_mutex;
+  json::JsonObject m_usage_object;
+
+  Usage record(const char *name, size_t peak_bytes, size_t allocation_count);
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_MEMORY_HPP
@@ -0,0 +1,53 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_METRICS_HPP
+#define SERVICE_API_SERVICE_METRICS_HPP
+
+#include <json/Json.hpp>
+#include <var/StackString.hpp>
+#include <var/Vector.hpp>
+
+namespace service {
+
+/*!
+ * \brief Metrics class
+ * \details The Metrics class is a process-wide registry
+ * of objects that report runtime statistics. Each
+ * Source registers itself when it is constructed and
+ * is removed when it is destroyed.
+ *
+ * ```cpp
+ * printer().object("metrics", Metrics::get_metrics());
+ * ```
+ *
+ */
+class Metrics {
+public:
+  class Source {
+  public:
+    explicit Source(const var::StringView name);
+    Source(const Source &) = delete;
+    Source &operator=(const Source &) = delete;
+    virtual ~Source();
+
+    const var::KeyString &metrics_name() const { return m_metrics_name; }
+
+    virtual json::JsonObject get_metrics() const = 0;
+
+  private:
+    var::KeyString m_metrics_name;
+  };
+
+  // snapshot of every registered source keyed by name
+  static json::JsonObject get_metrics();
+  static json::JsonObject get_metrics(const var::StringView name);
+
+private:
+  static void add_source(Source *source);
+  static void remove_source(Source *source);
+  static var::Vector<Source *> &source_list();
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_METRICS_HPP
@@ -53,6 +53,12 @@ public:
     API_ACCESS_COMPOUND(SaveBuild, var::StringView, build_name);
     API_ACCESS_COMPOUND(SaveBuild, var::StringView, sign_key);
     API_ACCESS_COMPOUND(SaveBuild, var::StringView, sign_key_password);
+    // store images as chunks shared by the builds of the project
+    API_ACCESS_BOOL(SaveBuild, chunk_storage, false);
+    // compress images before they are encrypted and uploaded
+    API_ACCESS_BOOL(SaveBuild, compressed_storage, false);
+    // import the build directories on worker threads
+    API_ACCESS_BOOL(SaveBuild, parallel_import, false);
   };
 
   Project &save_build(const SaveBuild &options);
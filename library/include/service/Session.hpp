@@ -0,0 +1,108 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_SESSION_HPP
+#define SERVICE_API_SERVICE_SESSION_HPP
+
+#include <chrono/ClockTimer.hpp>
+#include <cloud/CloudAccess.hpp>
+#include <crypto/Aes.hpp>
+#include <json/Json.hpp>
+#include <var/StackString.hpp>
+
+#include "Metrics.hpp"
+
+namespace service {
+
+/*!
+ * \brief Session class
+ * \details The Session class restores cloud credentials
+ * from a local cache so that short-lived processes
+ * don't need to log in before every document request.
+ *
+ * The credentials are restored in this order:
+ *
+ * 1. If the cached token has not expired, it is used as is
+ * 2. If a refresh token is cached, the token is renewed
+ * 3. If an email and password are provided, the user logs in
+ *
+ * The cache file is only readable by the owner. The tokens are
+ * encrypted with AES-256-CBC using the key. Without a key the
+ * tokens are only cached if `plaintext` is set.
+ *
+ * ```cpp
+ * Session session(Session::Construct()
+ *   .set_path(cache_path)
+ *   .set_email(email)
+ *   .set_password(password));
+ * ```
+ *
+ */
+class Session : public cloud::CloudAccess, public Metrics::Source {
+public:
+  enum class Origin { none, cache, refresh, login };
+
+  class Construct {
+  public:
+    // ID tokens are valid for one hour
+    Construct() { set_token_lifetime(3000_seconds); }
+
+  private:
+    API_AC(Construct, var::StringView, path);
+    API_AC(Construct, var::StringView, email);
+    API_AC(Construct, var::StringView, password);
+    // optional 64 character hex key used to encrypt the tokens
+    API_AC(Construct, var::StringView, key);
+    // allows caching tokens without a key
+    API_AB(Construct, plaintext, false);
+    API_AC(Construct, chrono::MicroTime, token_lifetime);
+  };
+
+  class Cache : public json::JsonValue {
+  public:
+    JSON_ACCESS_CONSTRUCT_OBJECT(Cache);
+    JSON_ACCESS_STRING(Cache, uid);
+    JSON_ACCESS_STRING(Cache, email);
+    JSON_ACCESS_INTEGER_WITH_KEY(Cache, expiresAt, expires_at);
+    JSON_ACCESS_STRING(Cache, token);
+    JSON_ACCESS_STRING_WITH_KEY(Cache, refreshToken, refresh_token);
+    // used instead of token and refreshToken when a key is provided
+    JSON_ACCESS_STRING(Cache, iv);
+    JSON_ACCESS_STRING(Cache, blob);
+  };
+
+  explicit Session(const Construct &options);
+
+  static var::StringView origin_name(Origin value);
+
+  Origin origin() const { return m_origin; }
+  const chrono::MicroTime &startup_time() const { return m_startup_time; }
+  bool is_valid() const { return m_origin != Origin::none; }
+
+  // write the current credentials to the cache
+  Session &save();
+  // delete the cache (logout)
+  Session &remove();
+
+  json::JsonObject get_metrics() const override;
+
+private:
+  var::PathString m_path;
+  var::KeyString m_email;
+  var::GeneralString m_key;
+  chrono::MicroTime m_token_lifetime;
+  bool m_is_plaintext;
+  Origin m_origin = Origin::none;
+  chrono::MicroTime m_startup_time;
+
+  bool restore_from_cache();
+  bool refresh_token(const Cache &cache);
+  bool login(const Construct &options);
+
+  Cache encrypt_cache(const Cache &cache) const;
+  Cache decrypt_cache(const Cache &cache) const;
+  bool is_encrypted() const { return m_key.is_empty() == false; }
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_SESSION_HPP
@@ -3,6 +3,9 @@
 #ifndef SERVICE_API_SERVICE_TEAM_HPP
 #define SERVICE_API_SERVICE_TEAM_HPP
 
+#include <chrono/MicroTime.hpp>
+#include <var/Vector.hpp>
+
 #include "Document.hpp"
 
 namespace service {
@@ -12,7 +15,7 @@ public:
   class User : public DocumentAccess<User> {
   public:
     User(const Id &team, const Id &id = "")
-      : DocumentAccess(Path("teams") / team / "users", id) {}
+      : DocumentAccess(Path("teams") / team / "users", id), m_team(team) {}
 
     JSON_ACCESS_BOOL(User, create);
     JSON_ACCESS_BOOL(User, remove);
@@ -20,10 +23,42 @@ public:
     JSON_ACCESS_BOOL(User, update);
     JSON_ACCESS_BOOL(User, write);
     JSON_ACCESS_BOOL(User, admin);
+
+    const Id &team() const { return m_team; }
+
+  protected:
+    // saving or removing a user invalidates the cached copy
+    void interface_save() override;
+    void interface_remove() override;
+    void interface_save_if_unchanged() override;
+
+  private:
+    Id m_team;
   };
 
   Team(const Id &id = Id());
   JSON_ACCESS_STRING(Team, name);
+
+  /*!
+   * Gets the permissions of `uid` on `team`. The first lookup
+   * reads the document. Later lookups by the same signed in
+   * user return the cached copy until it expires or is
+   * invalidated. A user that is not on the team is cached as
+   * well (`is_existing()` is false). A read that fails is not
+   * cached and sets the error. The cache holds up to 256 users.
+   *
+   */
+  static User get_user(const Id &team, const Id &uid);
+
+  // looks up the permissions of `uid` on each team in `team_list`,
+  // only teams that aren't cached are read (once per team)
+  static var::Vector<User>
+  get_user_list(const var::Vector<Id> &team_list, const Id &uid);
+
+  // call when a watch event reports a change; empty values match all
+  static void invalidate_user(const Id &team = Id(), const Id &uid = Id());
+
+  static void set_user_cache_lifetime(const chrono::MicroTime &lifetime);
 };
 
 } // namespace service
@@ -0,0 +1,83 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_TIMELINE_HPP
+#define SERVICE_API_SERVICE_TIMELINE_HPP
+
+#include <atomic>
+
+#include <chrono/ClockTime.hpp>
+#include <fs/File.hpp>
+#include <json/Json.hpp>
+#include <thread/Mutex.hpp>
+#include <var/StackString.hpp>
+#include <var/Vector.hpp>
+
+namespace service {
+
+/*!
+ * \brief Timeline class
+ * \details The Timeline class records spans of work and
+ * writes them in the Chrome trace-event format. The file
+ * can be opened with Perfetto or `chrome://tracing`.
+ *
+ * Recording is off until `Timeline::start()` is called.
+ * When it is off, a Span costs one flag check.
+ *
+ * ```cpp
+ * Timeline::start();
+ * {
+ *   Timeline::Span span("import", "build");
+ *   // work
+ * }
+ * Timeline::stop(File(File::IsOverwrite::yes, "trace.json"));
+ * ```
+ *
+ */
+class Timeline {
+public:
+  class Span {
+  public:
+    explicit Span(const char *name, const char *category = "service");
+    ~Span();
+
+    Span(const Span &) = delete;
+    Span &operator=(const Span &) = delete;
+
+  private:
+    const char *m_name;
+    const char *m_category;
+    u64 m_start = 0;
+    bool m_is_recording;
+  };
+
+  class Event {
+    API_AF(Event, const char *, name, "");
+    API_AF(Event, const char *, category, "");
+    // microseconds, 64 bits so long recordings don't wrap
+    API_AF(Event, u64, start, 0);
+    API_AF(Event, u64, duration, 0);
+    API_AF(Event, u32, thread_id, 0);
+  };
+
+  static void start();
+  // writes the recorded events and stops recording
+  static void stop(const fs::FileObject &file);
+
+  static bool is_recording() { return m_is_recording; }
+
+  static json::JsonObject to_object();
+
+private:
+  static std::atomic<bool> m_is_recording;
+
+  static thread::Mutex &mutex();
+  static u64 &origin();
+  static u64 get_timestamp();
+  static var::Vector<Event> &event_list();
+  static u32 get_thread_id();
+  static void add_event(const Event &event);
+};
+
+} // namespace service
+
+#endif // SERVICE_API_SERVICE_TIMELINE_HPP
@@ -0,0 +1,39 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef SERVICE_API_SERVICE_TRACE_HPP
+#define SERVICE_API_SERVICE_TRACE_HPP
+
+#include <cloud/CloudObject.hpp>
+#include <printer/Printer.hpp>
+
+#include "Config.hpp"
+
+/*!
+ * SERVICE_PRINTER_TRACE() is CLOUD_PRINTER_TRACE() with lazy
+ * evaluation. The message expression (string concatenation,
+ * NumberString formatting) is only evaluated if the printer
+ * is at the trace level.
+ *
+ * Configuring with `SERVICE_API_IS_TRACE=OFF` removes the trace
+ * sites entirely. The value comes from the generated Config.hpp
+ * so the library and its users always agree.
+ *
+ */
+#if SERVICE_API_IS_TRACE
+#define SERVICE_PRINTER_IS_TRACE()                                             \
+  (printer().verbose_level() == printer::Printer::Level::trace)
+
+#define SERVICE_PRINTER_TRACE(msg)                                             \
+  do {                                                                         \
+    if (SERVICE_PRINTER_IS_TRACE()) {                                          \
+      CLOUD_PRINTER_TRACE(msg);                                                \
+    }                                                                          \
+  } while (0)
+#else
+#define SERVICE_PRINTER_IS_TRACE() false
+#define SERVICE_PRINTER_TRACE(msg)                                             \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif // SERVICE_API_SERVICE_TRACE_HPP
@@ -2,6 +2,13 @@
 
 #include <sdk/types.h>
 
+#include <atomic>
+#include <cstring>
+
+#if defined __link
+#include <sys/stat.h>
+#endif
+
 #include <crypto.hpp>
 #include <cxxabi.h>
 #include <fs.hpp>
@@ -10,13 +17,257 @@
 #include <sos.hpp>
 #include <swd/Elf.hpp>
 #include <sys.hpp>
+#include <thread.hpp>
 #include <var.hpp>
 
 #include "service/Build.hpp"
+#include "service/BuildStream.hpp"
+#include "service/Compression.hpp"
+#include "service/Governor.hpp"
+#include "service/MappedFile.hpp"
+#include "service/Memory.hpp"
 #include "service/Project.hpp"
+#include "service/Timeline.hpp"
 
 using namespace service;
 
+namespace {
+// ELF32 layouts, firmware images are always 32-bit
+typedef struct {
+  u8 ident[16];
+  u16 type;
+  u16 machine;
+  u32 version;
+  u32 entry;
+  u32 program_header_offset;
+  u32 section_header_offset;
+  u32 flags;
+  u16 header_size;
+  u16 program_header_size;
+  u16 program_header_count;
+  u16 section_header_size;
+  u16 section_header_count;
+  u16 section_name_index;
+} elf_header_t;
+
+typedef struct {
+  u32 name;
+  u32 type;
+  u32 flags;
+  u32 address;
+  u32 offset;
+  u32 size;
+  u32 link;
+  u32 info;
+  u32 alignment;
+  u32 entry_size;
+} elf_section_header_t;
+
+typedef struct {
+  u32 name;
+  u32 value;
+  u32 size;
+  u8 info;
+  u8 other;
+  u16 section_index;
+} elf_symbol_t;
+
+// bundle files start with this header, see Build::export_bundle()
+typedef struct {
+  char magic[8];
+  u32 version;
+  u32 manifest_size;
+  // payload offsets in the manifest are relative to this
+  u32 payload_offset;
+  u32 reserved;
+} bundle_header_t;
+
+const char bundle_magic[8] = {'S', 'L', 'B', 'U', 'N', 'D', 'L', 'E'};
+constexpr u32 bundle_version = 1;
+constexpr size_t bundle_page_size = 4096;
+
+size_t get_bundle_page_aligned(size_t size) {
+  return (size + bundle_page_size - 1) & ~(bundle_page_size - 1);
+}
+
+void write_bundle_padding(const fs::FileObject &file, size_t size) {
+  static const var::Array<u8, 256> zero_block = {};
+  while (size) {
+    const size_t write_size
+      = size < zero_block.count() ? size : zero_block.count();
+    file.write(var::View(zero_block).truncate(write_size));
+    size -= write_size;
+  }
+}
+
+var::GeneralString get_sha256_string(const var::View data) {
+  return var::View(crypto::Sha256().update(data).output())
+    .to_string<var::GeneralString>();
+}
+
+/*
+ * Content-defined chunking with a gear hash. A boundary is
+ * placed where the top bits of the rolling hash are zero so
+ * an edit only moves the boundaries near it. Chunks are
+ * about 10 KiB and are kept between 2 KiB and 32 KiB. The table
+ * must never change or stored chunks stop matching.
+ */
+constexpr size_t chunk_minimum_size = 2048;
+constexpr size_t chunk_maximum_size = 32768;
+constexpr u32 chunk_boundary_mask = 0xfff80000;
+
+const var::Array<u32, 256> &get_gear_table() {
+  static const var::Array<u32, 256> table = []() {
+    var::Array<u32, 256> result;
+    // splitmix64 with a fixed seed
+    u64 state = 0x9e3779b97f4a7c15ULL;
+    for (auto &value : result) {
+      state += 0x9e3779b97f4a7c15ULL;
+      u64 z = state;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      value = u32((z ^ (z >> 31)) >> 32);
+    }
+    return result;
+  }();
+  return table;
+}
+
+var::Vector<size_t> get_chunk_size_list(const var::View image) {
+  const auto &gear_table = get_gear_table();
+  const u8 *data = image.to_const_u8();
+  var::Vector<size_t> result;
+  size_t start = 0;
+  u32 hash = 0;
+  for (size_t offset = 0; offset < image.size(); offset++) {
+    hash = (hash << 1) + gear_table.at(data[offset]);
+    const size_t size = offset + 1 - start;
+    if (
+      size >= chunk_maximum_size
+      || (size >= chunk_minimum_size && (hash & chunk_boundary_mask) == 0)) {
+      result.push_back(size);
+      start = offset + 1;
+      hash = 0;
+    }
+  }
+  if (start < image.size()) {
+    result.push_back(image.size() - start);
+  }
+  return result;
+}
+
+// the chunk hash is its key, the IV is derived from the key
+var::GeneralString get_chunk_initialization_vector(const var::StringView hash) {
+  return var::GeneralString(
+    get_sha256_string(var::View(hash)).string_view().get_substring_with_length(
+      32));
+}
+
+constexpr u32 elf_section_type_symbol_table = 2;
+constexpr u32 elf_section_type_no_bits = 8;
+
+template <typename Type>
+bool read_elf(const var::View elf, size_t offset, Type &value) {
+  if (offset > elf.size() || sizeof(Type) > elf.size() - offset) {
+    return false;
+  }
+  ::memcpy(&value, elf.to_const_u8() + offset, sizeof(Type));
+  return true;
+}
+
+/*
+ * Finds the data of each symbol in `name_list` with one
+ * pass over .symtab that stops when every name is found.
+ * The result has an empty view for names that are missing.
+ *
+ * .hash/.gnu.hash only index the dynamic symbol table, which
+ * statically linked firmware doesn't have, so the scan is used.
+ */
+var::Vector<var::View> find_elf_symbol_data(
+  const var::View elf,
+  const var::Vector<var::StringView> &name_list) {
+  var::Vector<var::View> result;
+  result.resize(name_list.count());
+
+  elf_header_t header;
+  if (
+    read_elf(elf, 0, header) == false || ::memcmp(header.ident, "\x7f" "ELF", 4)
+    || header.ident[4] != 1) {
+    return result;
+  }
+
+  auto read_section = [&](u32 index, elf_section_header_t &section) {
+    return index < header.section_header_count
+           && read_elf(
+             elf,
+             header.section_header_offset
+               + index * header.section_header_size,
+             section);
+  };
+
+  for (u32 i = 0; i < header.section_header_count; i++) {
+    elf_section_header_t symbol_section;
+    elf_section_header_t string_section;
+    if (
+      read_section(i, symbol_section) == false
+      || symbol_section.type != elf_section_type_symbol_table
+      || read_section(symbol_section.link, string_section) == false
+      || string_section.offset > elf.size()) {
+      continue;
+    }
+
+    const char *string_table
+      = reinterpret_cast<const char *>(elf.to_const_u8())
+        + string_section.offset;
+    const size_t string_table_size
+      = string_section.size < elf.size() - string_section.offset
+          ? string_section.size
+          : elf.size() - string_section.offset;
+
+    size_t remaining = name_list.count();
+    const u32 symbol_count = symbol_section.size / sizeof(elf_symbol_t);
+    for (u32 j = 0; j < symbol_count && remaining > 0; j++) {
+      elf_symbol_t symbol;
+      if (
+        read_elf(elf, symbol_section.offset + j * sizeof(symbol), symbol)
+          == false
+        || symbol.size == 0 || symbol.name >= string_table_size) {
+        continue;
+      }
+
+      const var::StringView name(
+        string_table + symbol.name,
+        ::strnlen(string_table + symbol.name, string_table_size - symbol.name));
+      for (size_t k = 0; k < name_list.count(); k++) {
+        elf_section_header_t data_section;
+        if (
+          result.at(k).size() == 0 && name == name_list.at(k)
+          && read_section(symbol.section_index, data_section)
+          && data_section.type != elf_section_type_no_bits) {
+          // the symbol value is an address in its section
+          const size_t offset
+            = data_section.offset + (symbol.value - data_section.address);
+          if (offset <= elf.size() && symbol.size <= elf.size() - offset) {
+            result.at(k)
+              = var::View(elf.to_const_u8() + offset, symbol.size);
+            remaining--;
+          }
+        }
+      }
+    }
+    return result;
+  }
+
+  return result;
+}
+
+// guards the binary image lists, const accessors add decoded images
+thread::Mutex &binary_image_mutex() {
+  static thread::Mutex value;
+  return value;
+}
+} // namespace
+
 Build::Build(const Construct &options)
   : DocumentAccess(
     Path("projects") / options.project_id() / "builds",
@@ -25,20 +276,27 @@ Build::Build(const Construct &options)
   set_application_architecture(options.architecture());
 
   if (options.project_path().is_empty() == false) {
-    CLOUD_PRINTER_TRACE("import compiled project at " & options.project_path());
+    SERVICE_PRINTER_TRACE("import compiled project at " & options.project_path());
     import_compiled(ImportCompiled()
                       .set_path(options.project_path())
-                      .set_build(options.build_name()));
-    CLOUD_PRINTER_TRACE("done importing " | options.project_path());
+                      .set_build(options.build_name())
+                      .set_cache(options.is_import_cache())
+                      .set_parallel(options.is_parallel_import()));
+    SERVICE_PRINTER_TRACE("done importing " | options.project_path());
     if (is_error()) {
-      CLOUD_PRINTER_TRACE("failed to import the build");
+      SERVICE_PRINTER_TRACE("failed to import the build");
     }
     return;
   }
 
   if (options.binary_path().is_empty() == false) {
-    if (fs::Path::suffix(options.binary_path()) == "elf") {
-      CLOUD_PRINTER_TRACE("need to imlement importing elf binary");
+    const auto suffix = fs::Path::suffix(options.binary_path());
+    if (suffix == "elf") {
+      import_elf_binary(options.binary_path(), options.build_name());
+    } else if (suffix == bundle_suffix()) {
+      import_bundle(options.binary_path());
+    } else if (suffix == "json") {
+      import_file(File(options.binary_path()));
     }
 
     return;
@@ -51,34 +309,187 @@ Build::Build(const Construct &options)
 
   migrate_build_info_list_20200518();
 
-  crypto::Aes::Key key(
-    Aes::Key::Construct().set_key(get_key()).set_initialization_vector(
-      get_iv()));
+  // everything a transfer needs is copied out of the JSON before any
+  // workers start
+  class Download {
+  private:
+    API_AC(Download, var::String, name);
+    API_AC(Download, var::String, section);
+    API_AC(Download, Document::Path, storage_path);
+    API_AC(Download, var::String, key);
+    API_AC(Download, var::String, iv);
+    API_AF(Download, u32, size, 0);
+    API_AF(Download, u32, compressed_size, 0);
+    API_AB(Download, compressed, false);
+    API_AC(Download, var::String, hash);
+    API_AC(Download, var::Vector<var::String>, chunk_hash_list);
+    API_AC(Download, var::Vector<u32>, chunk_size_list);
+    API_AC(Download, var::Vector<Document::Path>, chunk_path_list);
+    API_AC(Download, var::Vector<var::String>, chunk_iv_list);
+    API_AC(Download, var::Data, image);
+    API_AC(Download, var::GeneralString, error_message);
+    API_AF(Download, int, error_number, 0);
+  };
+
+  auto get_download = [&](
+                        const StringView name,
+                        const StringView section,
+                        const auto &info) -> Download {
+    Download result = Download()
+                        .set_name(name)
+                        .set_section(section)
+                        .set_size(info.get_size())
+                        .set_hash(info.get_hash());
+
+    if (info.get_storage_path().is_empty() && info.chunk_list().count()) {
+      const auto chunk_list = info.chunk_list();
+      for (const auto &chunk : chunk_list) {
+        result.chunk_hash_list().push_back(chunk.get_hash());
+        result.chunk_size_list().push_back(chunk.get_size());
+        result.chunk_path_list().push_back(
+          create_chunk_storage_path(chunk.get_hash()));
+        result.chunk_iv_list().push_back(
+          get_chunk_initialization_vector(chunk.get_hash()).string_view());
+      }
+      return result;
+    }
+
+    // images shared with another build use its object and key
+    const bool is_shared = info.get_storage_path().is_empty() == false;
+    const bool is_compressed = info.get_compression() == Compression::name();
+    return result
+      .set_storage_path(
+        is_shared ? Document::Path(info.get_storage_path())
+                  : create_storage_path(name))
+      .set_key(is_shared ? info.get_storage_key() : get_key())
+      .set_iv(is_shared ? info.get_storage_iv() : get_iv())
+      .set_compressed(is_compressed)
+      .set_compressed_size(is_compressed ? info.get_compressed_size() : 0);
+  };
 
-  auto download_image = [&](StringView name, size_t size) -> var::Data{
-    DataFile image;
-    cloud_service().storage().get_object(
-      create_storage_path(name),
-      image);
+  auto download_object = [](
+                           cloud::CloudService &service,
+                           const Document::Path &storage_path,
+                           var::Data &image,
+                           size_t size,
+                           const StringView key,
+                           const StringView iv) -> var::GeneralString {
+    // the image is decrypted and hashed as it is received
+    DecryptStream decrypt_stream(image, size, key, iv);
+    fs::LambdaFile image_file;
+    image_file.set_write_callback(
+      [&decrypt_stream](int location, const var::View view) -> int {
+        return decrypt_stream.write(location, view);
+      });
+
+    Timeline::Span span("download", "storage");
+    Governor::Request request;
+    service.storage().get_object(storage_path, image_file);
+    return decrypt_stream.get_hash();
+  };
 
-    if (get_key().is_empty() == false) {
+  auto download_chunks
+    = [&](cloud::CloudService &service, const Download &download) -> var::Data {
+    var::Data result;
+    const auto &hash_list = download.chunk_hash_list();
+    const auto &size_list = download.chunk_size_list();
+    for (u32 i = 0; i < hash_list.count(); i++) {
+      const StringView chunk_hash = hash_list.at(i).string_view();
+      const u32 chunk_size = size_list.at(i);
+
+      // a chunk that repeats in the image (erased flash, padding) is
+      // copied from its first occurrence instead of fetched again
+      size_t offset = 0;
+      bool is_repeated = false;
+      for (u32 j = 0; j < i; j++) {
+        if (
+          hash_list.at(j).string_view() == chunk_hash
+          && size_list.at(j) == chunk_size) {
+          is_repeated = true;
+          break;
+        }
+        offset += size_list.at(j);
+      }
+      if (is_repeated) {
+        var::Data chunk_image(chunk_size);
+        memcpy(
+          chunk_image.data(),
+          var::View(result).to_const_u8() + offset,
+          chunk_size);
+        result.append(chunk_image);
+        continue;
+      }
 
-      DataFile decrypted_image
-        = DataFile()
-            .write(
-              image.seek(0),
-              AesCbcDecrypter()
-                .set_key256(key.key256())
-                .set_initialization_vector(key.initialization_vector()))
-            .move();
+      var::Data chunk_image;
+      const auto hash = download_object(
+        service,
+        download.chunk_path_list().at(i),
+        chunk_image,
+        chunk_size,
+        chunk_hash,
+        download.chunk_iv_list().at(i));
+      if (is_error()) {
+        return var::Data();
+      }
+      if (hash.string_view() != chunk_hash) {
+        API_ASSIGN_ERROR("chunk doesn't match its hash " | chunk_hash, EINVAL);
+        return var::Data();
+      }
+      result.append(chunk_image);
+    }
+    return result;
+  };
 
-      image.data() = decrypted_image.data().resize(size);
+  auto download_image
+    = [&](cloud::CloudService &service, const Download &download) -> var::Data {
+    const StringView name = download.name().string_view();
+    if (download.chunk_hash_list().count()) {
+      const auto result = download_chunks(service, download);
+      if (
+        is_success() && download.hash().is_empty() == false
+        && calculate_hash(result).string_view()
+             != download.hash().string_view()) {
+        API_ASSIGN_ERROR("downloaded image doesn't match its hash " | name, EINVAL);
+        return var::Data();
+      }
+      return result;
     }
-    return image.data();
 
+    var::Data result;
+    auto hash = download_object(
+      service,
+      download.storage_path(),
+      result,
+      download.is_compressed() ? download.compressed_size() : download.size(),
+      download.key(),
+      download.iv());
+    if (is_error()) {
+      return var::Data();
+    }
+
+    if (download.is_compressed()) {
+      Timeline::Span span("decompress", "build");
+      result = Compression().decompress(result, download.size());
+      if (is_error()) {
+        return var::Data();
+      }
+      // the running hash covered the compressed bytes
+      hash = get_sha256_string(result);
+    }
+
+    // builds saved before images were hashed can't be verified
+    if (
+      download.hash().is_empty() == false
+      && hash.string_view() != download.hash().string_view()) {
+      API_ASSIGN_ERROR("downloaded image doesn't match its hash " | name, EINVAL);
+      return var::Data();
+    }
+    return result;
   };
 
-  // download the build images
+  // download the build images, each image is decrypted and hashed as it
+  // arrives. With more than one download service, each worker fetches
+  // through its own connection.
   if (options.build_name().is_empty() == false) {
 
     API_ASSERT(options.project_id().is_empty() == false);
@@ -86,28 +497,331 @@ Build::Build(const Construct &options)
 
     printer::Printer::Object build_object(printer(), options.build_name());
     ImageInfo image_info = build_image_info(options.build_name());
-    auto data = download_image(options.build_name(), image_info.get_size());
-    image_info.set_image_data(data);
 
-    auto section_list = image_info.section_list();
-    for(auto & section: section_list){
-      if( section.get_image() == "<base64>"){
-        printer::Printer::Object image_object(printer(), section.key());
-        auto section_data = download_image(options.build_name() & "." & section.key(), section.get_size());
-        section.set_image_data(section_data);
+    Vector<Download> download_list;
+    download_list.push_back(
+      get_download(options.build_name(), "", image_info));
+    const auto section_list = image_info.section_list();
+    for (const auto &section : section_list) {
+      if (section.get_image() == "<base64>") {
+        download_list.push_back(get_download(
+          options.build_name() & "." & section.key(),
+          section.key(),
+          section));
+      }
+    }
+
+    const auto &service_list = options.download_service_list();
+    if (service_list.count() > 1 && download_list.count() > 1) {
+      // a connection carries one transfer at a time so each worker
+      // signs its own service in with the credentials of this one
+      Mutex mutex;
+      size_t next_offset = 0;
+      bool is_failed = false;
+      auto worker = [&](cloud::CloudService *service) {
+        while (true) {
+          size_t offset;
+          {
+            Mutex::Guard mutex_guard(mutex);
+            if (next_offset == download_list.count() || is_failed) {
+              return;
+            }
+            offset = next_offset++;
+          }
+
+          Download &download = download_list.at(offset);
+          download.image() = download_image(*service, download);
+          if (is_error()) {
+            // errors belong to the thread so they are carried to the caller
+            download.set_error_message(error().message())
+              .set_error_number(error().error_number());
+            API_RESET_ERROR();
+            Mutex::Guard mutex_guard(mutex);
+            is_failed = true;
+          }
+        }
+      };
+
+      const size_t thread_count = service_list.count() < download_list.count()
+                                    ? service_list.count()
+                                    : download_list.count();
+      Vector<Thread> thread_list;
+      for (size_t i = 0; i < thread_count; i++) {
+        cloud::CloudService *service = service_list.at(i);
+        service->cloud().set_credentials(
+          cloud_service().store().credentials());
+        thread_list.push_back(Thread(
+          Thread::Attributes().set_joinable(),
+          [&worker, service]() -> void * {
+            worker(service);
+            return nullptr;
+          }));
       }
+      for (auto &thread : thread_list) {
+        thread.join();
+      }
+    } else {
+      for (auto &download : download_list) {
+        if (download.section().is_empty()) {
+          download.image() = download_image(cloud_service(), download);
+        } else {
+          printer::Printer::Object image_object(
+            printer(),
+            download.section().string_view());
+          download.image() = download_image(cloud_service(), download);
+        }
+        API_RETURN_IF_ERROR();
+      }
+    }
+
+    for (auto &download : download_list) {
+      if (download.error_number() != 0) {
+        API_RETURN_ASSIGN_ERROR(
+          download.error_message().cstring(),
+          download.error_number());
+      }
+      if (download.section().is_empty()) {
+        set_image(options.build_name(), download.image());
+      } else {
+        set_section_image(
+          options.build_name(),
+          download.section().string_view(),
+          download.image());
+      }
+    }
+
+    return;
+  }
+}
+
+Build::ImageInfo
+Build::import_elf_file(const var::StringView path, const var::StringView name) {
+  return store_elf_image(name, load_elf_file(path));
+}
+
+Build &Build::import_elf_binary(
+  const var::StringView path,
+  const var::StringView build_name) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  Memory::Operation memory_operation("import");
+  SERVICE_PRINTER_TRACE("import elf binary " | path);
+
+  // only the settings of the project that holds the build directory
+  // are read, the rest of the project isn't scanned
+  const PathString build_directory = fs::Path::parent_directory(path);
+  const var::StringView directory_name = fs::Path::name(build_directory);
+  const bool is_build_directory = directory_name.find("build_") == 0;
+
+  if (application_architecture().is_empty() && is_build_directory) {
+    m_application_architecture = get_arch(directory_name);
+  }
+
+  const var::NameString name = normalize_name(
+    build_name.is_empty() == false
+      ? build_name
+      : (is_build_directory ? directory_name : var::StringView("release")));
+
+  const PathString settings_path
+    = PathString(fs::Path::parent_directory(build_directory))
+      / Project::file_name();
+  if (is_build_directory && FileSystem().exists(settings_path)) {
+    const Project project_settings = Project().import_file(File(settings_path));
+    API_RETURN_VALUE_IF_ERROR(*this);
+    set_name(project_settings.get_name())
+      .set_project_id(project_settings.get_document_id())
+      .set_version(project_settings.get_version())
+      .set_type(project_settings.get_type())
+      .set_permissions(project_settings.get_permissions())
+      .set_ram_size(project_settings.get_ram_size());
+  } else {
+    // the caller sets the type when there are no settings
+    set_name(fs::Path::no_suffix(fs::Path::name(path)));
+  }
+
+  if (get_permissions().is_empty()) {
+    set_permissions("public");
+  }
+  set_image_included(true);
+
+  ElfImage elf_image = load_elf_file(path);
+  API_RETURN_VALUE_IF_ERROR(*this);
+
+  if (is_application()) {
+    apply_application_attributes(
+      elf_image.image(),
+      get_name(),
+      get_project_id(),
+      sys::Version(get_version()).to_bcd16());
+    API_RETURN_VALUE_IF_ERROR(*this);
+  }
+
+  Vector<ImageInfo> local_build_image_list;
+  local_build_image_list.push_back(
+    store_elf_image(name, elf_image).set_name(name.string_view()));
+  set_build_image_list(local_build_image_list);
+  return *this;
+}
+
+void Build::apply_application_attributes(
+  var::Data &image,
+  const var::StringView name,
+  const var::StringView id,
+  u16 version) {
+  // make sure settings are populated in the binary
+  ViewFile data_image(image);
+
+  if (data_image.size() == 0) {
+    API_RETURN_ASSIGN_ERROR(
+      "Failed to load any program data. There might be a problem with "
+      "the firmware image.",
+      EINVAL);
+  }
+
+  Appfs::FileAttributes(data_image.seek(0).set_flags(OpenMode::read_write()))
+    .set_name(name)
+    .set_id(id)
+    .set_startup(false)
+    .set_flash(false)
+    .set_ram_size(0)
+    .set_version(version)
+    .apply(data_image);
+}
+
+Build::ImageInfo
+Build::store_elf_image(const var::StringView name, const ElfImage &elf_image) {
+  store_binary_image(get_binary_image_name(name, ""), elf_image.image());
+  for (const auto &section_image : elf_image.section_image_list()) {
+    store_binary_image(
+      get_binary_image_name(name, section_image.name()),
+      section_image.data());
+  }
+  return elf_image.info();
+}
+
+bool Build::load_import_cache(
+  const var::StringView cache_path,
+  const var::StringView elf_path,
+  const var::StringView settings_hash,
+  ElfImage &elf_image) {
+  // a missing or damaged cache only means the ELF is imported again
+  api::ErrorScope error_scope;
+  const PathString entry_path = PathString(cache_path).append(".json");
+  if (FileSystem().exists(entry_path) == false) {
+    return false;
+  }
+
+  ImportCacheEntry entry = JsonDocument().load(File(entry_path)).to_object();
+  if (is_error() || entry.get_settings_hash() != settings_hash) {
+    return false;
+  }
+
+  const ImportCacheEntry elf_entry = get_elf_file_entry(elf_path);
+  if (entry.get_elf_size() != elf_entry.get_elf_size()) {
+    return false;
+  }
+
+  // without a timestamp the contents are always compared, a new
+  // timestamp with the same contents is still a match
+  const bool is_modified_available = elf_entry.get_elf_modified() != 0;
+  const bool is_modified
+    = entry.get_elf_modified() != elf_entry.get_elf_modified();
+  if (is_modified_available == false || is_modified) {
+    const MappedFile elf_file(elf_path);
+    if (
+      is_error()
+      || entry.get_elf_hash() != get_sha256_string(elf_file.view())) {
+      return false;
     }
+  }
+
+  ElfImage result;
+  result.set_info(entry.get_image_info());
+  result.image()
+    = DataFile().write(File(PathString(cache_path).append(".bin"))).data();
+  const auto section_list = result.info().section_list();
+  for (const auto &section : section_list) {
+    result.section_image_list().push_back(
+      BinaryImage().set_name(section.key()).set_data(
+        DataFile()
+          .write(File(PathString(cache_path) & "." & section.key() & ".bin"))
+          .data()));
+  }
+
+  if (is_error() || result.image().size() != u32(result.info().get_size())) {
+    return false;
+  }
 
+  if (is_modified_available && is_modified) {
+    // the next import trusts the new timestamp rather than hashing again
+    entry.set_elf_modified(elf_entry.get_elf_modified());
+    JsonDocument().save(entry, File(File::IsOverwrite::yes, entry_path));
+  }
+
+  SERVICE_PRINTER_TRACE("using cached import for " | elf_path);
+  elf_image = result;
+  return true;
+}
+
+void Build::save_import_cache(
+  const var::StringView cache_path,
+  const var::StringView elf_path,
+  const var::StringView settings_hash,
+  const ElfImage &elf_image) {
+  // failing to write the cache doesn't fail the import
+  api::ErrorScope error_scope;
+  const MappedFile elf_file(elf_path);
+  if (is_error()) {
     return;
   }
+
+  File(File::IsOverwrite::yes, PathString(cache_path).append(".bin"))
+    .write(elf_image.image());
+  for (const auto &section_image : elf_image.section_image_list()) {
+    File(
+      File::IsOverwrite::yes,
+      PathString(cache_path) & "." & section_image.name() & ".bin")
+      .write(section_image.data());
+  }
+
+  // the entry is written last so a partial cache is never used
+  ImportCacheEntry entry = get_elf_file_entry(elf_path);
+  entry.set_elf_hash(get_sha256_string(elf_file.view()))
+    .set_settings_hash(settings_hash)
+    .set_image_info(elf_image.info());
+  JsonDocument().save(
+    entry,
+    File(File::IsOverwrite::yes, PathString(cache_path).append(".json")));
+}
+
+Build::ImportCacheEntry
+Build::get_elf_file_entry(const var::StringView elf_path) {
+  ImportCacheEntry result;
+#if defined __link
+  struct stat stat_info;
+  if (::stat(PathString(elf_path).cstring(), &stat_info) == 0) {
+    result.set_elf_size(stat_info.st_size)
+      .set_elf_modified(stat_info.st_mtime);
+  }
+#else
+  const auto info = FileSystem().get_info(elf_path);
+  result.set_elf_size(info.size());
+#endif
+  return result;
 }
 
-Build::ImageInfo Build::import_elf_file(const var::StringView path) {
-  File elf_file(path);
+Build::ElfImage Build::load_elf_file(const var::StringView path) {
+  Timeline::Span span("import_elf_file", "build");
+  ElfImage result;
+  // segments are sliced from the mapping and copied once into the image
+  MappedFile mapped_file(path);
+  if (is_error()) {
+    return result;
+  }
+  ViewFile elf_file(mapped_file.view());
   swd::Elf elf(elf_file);
 
-  CLOUD_PRINTER_TRACE("importing ELF file " | path);
-  DataFile data_image;
+  SERVICE_PRINTER_TRACE("importing ELF file " | path);
+  var::Data &data_image = result.image();
 
   typedef struct MCU_PACK {
     u32 address;
@@ -121,104 +835,122 @@ Build::ImageInfo Build::import_elf_file(const var::StringView path) {
   json::JsonKeyValueList<SectionImageInfo> section_list;
 
   {
-    api::ErrorGuard error_guard;
-    const auto symbol_list = elf.get_symbol_list();
-    swd::Elf::Symbol mcu_board_config_symbol
-      = symbol_list.find(swd::Elf::Symbol("mcu_board_config"));
-
-    if (mcu_board_config_symbol.size()) {
-      CLOUD_PRINTER_TRACE("loading mcu board config (deprecated in v4)");
-      elf.load(mcu_board_config_symbol, ViewFile(var::View(mcu_board_config)));
+    const auto symbol_data_list = find_elf_symbol_data(
+      mapped_file.view(),
+      {"mcu_board_config", "sos_config"});
+    const var::View mcu_board_config_data = symbol_data_list.at(0);
+    const var::View sos_config_data = symbol_data_list.at(1);
+
+    if (mcu_board_config_data.size()) {
+      SERVICE_PRINTER_TRACE("loading mcu board config (deprecated in v4)");
+      ::memcpy(
+        &mcu_board_config,
+        mcu_board_config_data.to_const_void(),
+        mcu_board_config_data.size() < sizeof(mcu_board_config)
+          ? mcu_board_config_data.size()
+          : sizeof(mcu_board_config));
       key.address = mcu_board_config.secret_key_address;
       key.size = mcu_board_config.secret_key_size;
     } else {
-      CLOUD_PRINTER_TRACE("no mcu_board_config find sos_config");
-
-      swd::Elf::Symbol sos_config_symbol
-        = symbol_list.find(swd::Elf::Symbol("sos_config"));
+      SERVICE_PRINTER_TRACE("no mcu_board_config find sos_config");
 
-      if (sos_config_symbol.size()) {
-        CLOUD_PRINTER_TRACE(
-          "found sos_config " | NumberString(sos_config_symbol.size())
+      if (sos_config_data.size()) {
+        SERVICE_PRINTER_TRACE(
+          "found sos_config " | NumberString(sos_config_data.size())
           | ", loading key data ");
-        elf.load(sos_config_symbol, ViewFile(View(key)));
+        ::memcpy(
+          &key,
+          sos_config_data.to_const_void(),
+          sos_config_data.size() < sizeof(key) ? sos_config_data.size()
+                                               : sizeof(key));
       }
     }
   }
 
-  CLOUD_PRINTER_TRACE("key size is " | NumberString(key.size));
+  SERVICE_PRINTER_TRACE("key size is " | NumberString(key.size));
 
   // Data image is the loadable sections of the ELF file
   auto program_header_list
     = elf.get_program_header_list(swd::Elf::ProgramHeaderType::load);
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "ELF has " | NumberString(program_header_list.count())
     | " loadable program headers");
 
+  size_t load_size = 0;
+  for (const swd::Elf::ProgramHeader &program_header : program_header_list) {
+    load_size += program_header.file_size();
+  }
+  data_image.reserve(load_size);
+
   u32 text_start_location = 0;
   for (const swd::Elf::ProgramHeader &program_header : program_header_list) {
+    const var::View segment = mapped_file.get_view(
+      program_header.offset(),
+      program_header.file_size());
+    if (segment.size() != program_header.file_size()) {
+      API_ASSIGN_ERROR("ELF program header is outside of the file", EINVAL);
+      return result;
+    }
 
     printer().object(
       "programHeader",
       program_header,
       printer::Printer::Level::debug);
-    const auto name = elf.get_section_name(program_header);
+    const auto section_name = elf.get_section_name(program_header);
 
-    if (name == ".text" || name == ".data") {
-      CLOUD_PRINTER_TRACE("adding section text/data to build");
-      if (name == ".text") {
-        CLOUD_PRINTER_TRACE(
+    if (section_name == ".text" || section_name == ".data") {
+      SERVICE_PRINTER_TRACE("adding section text/data to build");
+      if (section_name == ".text") {
+        SERVICE_PRINTER_TRACE(
           "adding text bytes " | NumberString(program_header.memory_size()));
         text_start_location = program_header.physical_address();
       } else {
-        CLOUD_PRINTER_TRACE(
+        SERVICE_PRINTER_TRACE(
           "adding data bytes " | NumberString(program_header.memory_size()));
       }
-      data_image.write(
-        elf.file().seek(program_header.offset()),
-        File::Write().set_size(program_header.file_size()));
-      CLOUD_PRINTER_TRACE(
-        "data image size is now " | NumberString(data_image.data().size()));
+      data_image.append(segment);
+      SERVICE_PRINTER_TRACE(
+        "data image size is now " | NumberString(data_image.size()));
 
     } else {
-      CLOUD_PRINTER_TRACE("adding section " + name + " to build");
-      section_list.push_back(
-        SectionImageInfo(name).set_signed(false).set_image_data(
-          DataFile()
-            .write(
-              elf.file().seek(program_header.offset()),
-              File::Write().set_size(program_header.file_size()))
-            .data()));
+      SERVICE_PRINTER_TRACE("adding section " + section_name + " to build");
+      result.section_image_list().push_back(
+        BinaryImage().set_name(section_name).set_data(var::Data(segment)));
+      section_list.push_back(SectionImageInfo(section_name)
+                               .set_signed(false)
+                               .set_image(binary_image_marker()));
     }
   }
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "loaded " | NumberString(section_list.count())
     | " additional sections error? " | (is_error() ? "true" : "false"));
 
-  CLOUD_PRINTER_TRACE("data image size is " | NumberString(data_image.size()));
+  SERVICE_PRINTER_TRACE("data image size is " | NumberString(data_image.size()));
 
   const u32 key_address
     = key.address != 0 ? (key.address - text_start_location) & ~0x01 : 0;
 
-  return Build::ImageInfo()
-    .set_signed(false)
-    .set_image_data(data_image.data())
-    .set_size(data_image.size())
-    .set_secret_key_position(key_address)
-    .set_secret_key_size(key.size)
-    .set_section_list(section_list);
+  result.set_info(Build::ImageInfo()
+                    .set_signed(false)
+                    .set_image(binary_image_marker())
+                    .set_size(data_image.size())
+                    .set_secret_key_position(key_address)
+                    .set_secret_key_size(key.size)
+                    .set_section_list(section_list));
+  return result;
 }
 
 Build &Build::import_compiled(const ImportCompiled &options) {
   API_RETURN_VALUE_IF_ERROR(*this);
+  Memory::Operation memory_operation("import");
   const auto project_settings_path = options.path() / Project::file_name();
-  CLOUD_PRINTER_TRACE("import " | project_settings_path.string_view());
+  SERVICE_PRINTER_TRACE("import " | project_settings_path.string_view());
   Project project_settings = Project().import_file(File(project_settings_path));
   API_RETURN_VALUE_IF_ERROR(*this);
 
-  CLOUD_PRINTER_TRACE("checking for path and project name match");
+  SERVICE_PRINTER_TRACE("checking for path and project name match");
   if (fs::Path::name(options.path()) != project_settings.get_name()) {
     API_RETURN_VALUE_ASSIGN_ERROR(
       *this,
@@ -227,17 +959,17 @@ Build &Build::import_compiled(const ImportCompiled &options) {
       EINVAL);
   }
 
-  CLOUD_PRINTER_TRACE("importing build entries from the project");
+  SERVICE_PRINTER_TRACE("importing build entries from the project");
   set_name(project_settings.get_name())
     .set_project_id(project_settings.get_document_id())
     .set_version(project_settings.get_version())
     .set_type(project_settings.get_type())
     .set_permissions(project_settings.get_permissions());
 
-  CLOUD_PRINTER_TRACE("build type is " | get_type());
+  SERVICE_PRINTER_TRACE("build type is " | get_type());
 
   if (get_permissions().is_empty()) {
-    CLOUD_PRINTER_TRACE("Setting default permissions to public");
+    SERVICE_PRINTER_TRACE("Setting default permissions to public");
     set_permissions("public");
   }
 
@@ -249,14 +981,16 @@ Build &Build::import_compiled(const ImportCompiled &options) {
     const PathString build_path
       = options.path() / normalize_name(options.build()).string_view();
     if (FileSystem().exists(build_path) == false) {
-      CLOUD_PRINTER_TRACE("build name provided but doesn't exist");
+      SERVICE_PRINTER_TRACE("build name provided but doesn't exist");
       API_RETURN_VALUE_ASSIGN_ERROR(*this, build_path.cstring(), ENOENT);
     }
   }
 
   const auto build_directory_list = FileSystem().read_directory(options.path());
 
-  Vector<ImageInfo> local_build_image_list;
+  // select the build directories first so the order doesn't depend on threads
+  Vector<var::NameString> import_list;
+  Vector<PathString> elf_path_list;
   for (const auto &build_directory_entry : build_directory_list) {
 
     if (
@@ -271,7 +1005,7 @@ Build &Build::import_compiled(const ImportCompiled &options) {
         && (build_directory_entry.string_view().find("_link") == StringView::npos);
 
     if (is_included) {
-      CLOUD_PRINTER_TRACE("checking build directory " & build_directory_entry);
+      SERVICE_PRINTER_TRACE("checking build directory " & build_directory_entry);
     }
 
     const var::NameString build_name = normalize_name(build_directory_entry);
@@ -282,7 +1016,7 @@ Build &Build::import_compiled(const ImportCompiled &options) {
         = (options.build().is_empty() || (build_name.string_view() == option_name.string_view()));
 
       if (is_included == false) {
-        CLOUD_PRINTER_TRACE("excluding " & options.build());
+        SERVICE_PRINTER_TRACE("excluding " & options.build());
       }
     }
 
@@ -294,63 +1028,182 @@ Build &Build::import_compiled(const ImportCompiled &options) {
                                       build_directory_entry)
                                       .string_view();
 
-      CLOUD_PRINTER_TRACE("elf path " & elf_path);
+      SERVICE_PRINTER_TRACE("elf path " & elf_path);
 
       if (FileSystem().exists(elf_path) == false) {
-        CLOUD_PRINTER_TRACE("elf file " & elf_path & " is missing");
+        SERVICE_PRINTER_TRACE("elf file " & elf_path & " is missing");
         API_RETURN_VALUE_ASSIGN_ERROR(*this, elf_path.cstring(), EINVAL);
       }
 
-      ImageInfo image_info = import_elf_file(elf_path);
+      import_list.push_back(var::NameString(build_directory_entry));
+      elf_path_list.push_back(elf_path);
+    }
+  }
 
-      DataFile data_image;
-      data_image.data() = image_info.get_image_data();
+  class ImportResult {
+    API_AC(ImportResult, ElfImage, elf_image);
+    API_AC(ImportResult, var::GeneralString, error_message);
+    API_AF(ImportResult, int, error_number, 0);
+    API_AF(ImportResult, u32, duration, 0);
+  };
 
-      if (is_application()) {
-        // make sure settings are populated in the binary
+  // the settings are copied out of the JSON before any threads start
+  const bool is_application_build = is_application();
+  const String project_name = project_settings.get_name();
+  const String project_id = project_settings.get_document_id();
+  const u16 project_version
+    = sys::Version(project_settings.get_version()).to_bcd16();
+
+  // cached images are only valid for the settings that produced them
+  const var::GeneralString settings_hash
+    = get_sha256_string(GeneralString()
+                          .append(project_name)
+                          .append("|")
+                          .append(project_id)
+                          .append("|")
+                          .append(NumberString(project_version))
+                          .append("|")
+                          .append(get_type()));
+  const PathString cache_directory
+    = options.path() / import_cache_directory();
+  if (options.is_cache() && FileSystem().exists(cache_directory) == false) {
+    api::ErrorScope error_scope;
+    FileSystem().create_directory(cache_directory);
+  }
 
-        if (data_image.size() == 0) {
-          API_RETURN_VALUE_ASSIGN_ERROR(
-            *this,
-            "Failed to load any program data. There might be a problem with "
-            "the firmware image.",
-            EINVAL);
-        }
+  Vector<ImportResult> import_result_list;
+  import_result_list.resize(import_list.count());
+  // set by the first variant that fails, later variants aren't imported
+  std::atomic<bool> is_failed(false);
 
-        CLOUD_PRINTER_TRACE(
-          "setting application details: error? "
-          | StringView((is_error() ? "true" : "false")));
-        const sys::Version version(project_settings.get_version());
-        Appfs::FileAttributes(
-          data_image.seek(0).set_flags(OpenMode::read_write()))
-          .set_name(String(project_settings.get_name()))
-          .set_id(String(project_settings.get_document_id()))
-          .set_startup(false)
-          .set_flash(false)
-          .set_ram_size(0)
-          .set_version(version.to_bcd16())
-          .apply(data_image);
-      }
+  auto import_build_directory = [&](size_t offset) {
+    ImportResult &result = import_result_list.at(offset);
+    ClockTimer import_timer;
+    import_timer.start();
+    const PathString cache_path = cache_directory / import_list.at(offset);
+    if (
+      options.is_cache()
+      && load_import_cache(
+        cache_path,
+        elf_path_list.at(offset),
+        settings_hash,
+        result.elf_image())) {
+      result.set_duration(import_timer.microseconds());
+      return;
+    }
+
+    result.set_elf_image(load_elf_file(elf_path_list.at(offset)));
+
+    if (is_success() && is_application_build) {
+      apply_application_attributes(
+        result.elf_image().image(),
+        project_name,
+        project_id,
+        project_version);
+    }
+
+    if (options.is_cache() && is_success()) {
+      save_import_cache(
+        cache_path,
+        elf_path_list.at(offset),
+        settings_hash,
+        result.elf_image());
+    }
 
-      local_build_image_list.push_back(
-        image_info.set_name(build_directory_entry)
-          .set_image_data(data_image.data()));
+    if (is_error()) {
+      // errors belong to the thread so they are carried to the caller
+      result.set_error_message(error().message())
+        .set_error_number(error().error_number());
+      API_RESET_ERROR();
+      is_failed = true;
+    }
+    result.set_duration(import_timer.microseconds());
+  };
 
-      ImageInfo printable_info
-        = json::JsonObject().copy(local_build_image_list.back()).to_object();
-      printable_info.set_image("<image data>");
-      for (auto &section : printable_info.section_list()) {
-        section.set_image("<image data>");
+  // the loader prints at the debug level, output from workers would
+  // interleave so debug imports are serial
+  const bool is_debug
+    = printer().verbose_level() >= printer::Printer::Level::debug;
+  const bool is_parallel = options.is_parallel() && options.thread_count() > 1
+                           && import_list.count() > 1 && is_debug == false;
+  if (options.is_parallel() && is_debug) {
+    printer().debug("importing serially at the debug level");
+  }
+
+  if (is_parallel) {
+    Mutex mutex;
+    size_t next_offset = 0;
+    auto worker = [&]() -> void * {
+      while (true) {
+        size_t offset;
+        {
+          Mutex::Guard mutex_guard(mutex);
+          if (next_offset == import_list.count() || is_failed) {
+            return nullptr;
+          }
+          // offsets are taken in order, all earlier variants are finished
+          // before the merge below reaches a failure
+          offset = next_offset++;
+        }
+        import_build_directory(offset);
       }
+    };
+
+    const u32 thread_count
+      = options.thread_count() < import_list.count()
+          ? options.thread_count()
+          : import_list.count();
+    Vector<Thread> thread_list;
+    for (u32 i = 0; i < thread_count; i++) {
+      thread_list.push_back(
+        Thread(Thread::Attributes().set_joinable(), worker));
+    }
+    for (auto &thread : thread_list) {
+      thread.join();
+    }
+  } else {
+    for (size_t offset = 0; offset < import_list.count() && !is_failed;
+         offset++) {
+      import_build_directory(offset);
+    }
+  }
+
+  Vector<ImageInfo> local_build_image_list;
+  for (size_t offset = 0; offset < import_list.count(); offset++) {
+    const auto &build_directory_entry = import_list.at(offset);
+    const ImportResult &result = import_result_list.at(offset);
+    if (result.error_number() != 0) {
+      API_RETURN_VALUE_ASSIGN_ERROR(
+        *this,
+        result.error_message().cstring(),
+        result.error_number());
+    }
+
+    ImageInfo image_info
+      = store_elf_image(build_directory_entry, result.elf_image());
+    local_build_image_list.push_back(image_info.set_name(build_directory_entry));
 
-      printer().object(
-        build_directory_entry,
-        printable_info,
-        printer::Printer::Level::debug);
+    // the image bytes are not in the JSON so it is small enough to print
+    printer().object(
+      build_directory_entry,
+      local_build_image_list.back(),
+      printer::Printer::Level::debug);
+  }
+
+  if (is_debug) {
+    json::JsonObject timing_object;
+    for (size_t offset = 0; offset < import_list.count(); offset++) {
+      timing_object.insert(
+        import_list.at(offset),
+        json::JsonReal(import_result_list.at(offset).duration() / 1000.0f));
     }
+    printer().object(
+      "importTimeMs",
+      timing_object,
+      printer::Printer::Level::debug);
   }
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "Update build image list with "
     | NumberString(local_build_image_list.count()) | " items");
   set_build_image_list(local_build_image_list);
@@ -359,31 +1212,412 @@ Build &Build::import_compiled(const ImportCompiled &options) {
 }
 
 Build &Build::import_url(const var::StringView url) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  Timeline::Span span("import_url", "build");
+
+  // images are decoded as they arrive, only the metadata is parsed
+  ImageFieldStream image_field_stream;
+  fs::LambdaFile response;
+  response.set_write_callback(
+    [&image_field_stream](int location, const var::View view) -> int {
+      return image_field_stream.write(location, view);
+    });
 
-  DataFile response;
   printer().set_progress_key("downloading");
   HttpSecureClient().connect(url).get(
     url,
     Http::Get().set_response(&response).set_progress_callback(
       printer().progress_callback()));
   printer().set_progress_key("progress");
-  to_object() = JsonDocument().load(response.seek(0)).to_object();
+  if (image_field_stream.is_invalid()) {
+    // the client error only says the response couldn't be written
+    API_RESET_ERROR();
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      *this,
+      "build download has an image that isn't base64",
+      EINVAL);
+  }
+  API_RETURN_VALUE_IF_ERROR(*this);
+
+  if (image_field_stream.is_complete() == false) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      *this,
+      "build download is incomplete",
+      EINVAL);
+  }
+
+  to_object()
+    = JsonDocument().from_string(image_field_stream.json()).to_object();
+  API_RETURN_VALUE_IF_ERROR(*this);
+  m_binary_image_list.clear();
+
+  auto &image_list = image_field_stream.image_list();
+  auto move_image = [&](auto &info, const var::StringView binary_name) {
+    const var::StringView image = info.get_image();
+    for (size_t i = 0; i < image_list.count(); i++) {
+      if (image == ImageFieldStream::get_placeholder(i).string_view()) {
+        m_binary_image_list.push_back(BinaryImage().set_name(binary_name));
+        // the decoded image is moved rather than copied
+        m_binary_image_list.back().data() = std::move(image_list.at(i));
+        info.set_image(binary_image_marker());
+        return;
+      }
+    }
+  };
+
+  auto build_list = build_image_list();
+  for (auto &image_info : build_list) {
+    const auto name = image_info.get_name();
+    move_image(image_info, get_binary_image_name(name, ""));
+    auto section_list = image_info.section_list();
+    for (auto &section : section_list) {
+      move_image(section, get_binary_image_name(name, section.key()));
+    }
+  }
   return *this;
 }
 
 var::Data Build::get_image(const var::StringView name) const {
-  return build_image_info(name).get_image_data();
+  const BinaryImage *result = load_binary_image(name, "");
+  return result != nullptr ? var::Data(result->get_view()) : var::Data();
+}
+
+var::View Build::get_image_view(const var::StringView name) const {
+  const BinaryImage *result = load_binary_image(name, "");
+  return result != nullptr ? result->get_view() : var::View();
+}
+
+Build &Build::set_image(const var::StringView name, const var::View image) {
+  store_binary_image(get_binary_image_name(name, ""), image);
+  build_image_info(name).set_image(binary_image_marker());
+  return *this;
+}
+
+var::Data Build::get_section_image(
+  const var::StringView name,
+  const var::StringView section) const {
+  const BinaryImage *result = load_binary_image(name, section);
+  return result != nullptr ? var::Data(result->get_view()) : var::Data();
+}
+
+var::View Build::get_section_image_view(
+  const var::StringView name,
+  const var::StringView section) const {
+  const BinaryImage *result = load_binary_image(name, section);
+  return result != nullptr ? result->get_view() : var::View();
+}
+
+Build &Build::set_section_image(
+  const var::StringView name,
+  const var::StringView section,
+  const var::View image) {
+  store_binary_image(get_binary_image_name(name, section), image);
+  auto section_list = build_image_info(name).section_list();
+  section_list.at(section).set_image(binary_image_marker());
+  return *this;
+}
+
+Build &Build::encode_binary_images() {
+  to_object() = get_encoded_object();
+  m_binary_image_list.clear();
+  return *this;
+}
+
+void Build::interface_export_file(const fs::File &file) const {
+  JsonDocument().save(get_encoded_object(), file);
+}
+
+json::JsonObject Build::get_encoded_object() const {
+  if (m_binary_image_list.empty()) {
+    return to_object();
+  }
+
+  // the build keeps its binary images, only the copy is encoded
+  json::JsonObject result = json::JsonObject().copy(to_object()).to_object();
+  json::JsonArray build_list = result.at("buildList").to_array();
+  for (u32 i = 0; i < build_list.count(); i++) {
+    ImageInfo image_info(build_list.at(i).to_object());
+    if (image_info.is_binary()) {
+      image_info.set_image_data(get_image(image_info.get_name()));
+    }
+    auto section_list = image_info.section_list();
+    for (auto &section : section_list) {
+      if (section.is_binary()) {
+        section.set_image_data(
+          get_section_image(image_info.get_name(), section.key()));
+      }
+    }
+  }
+  return result;
+}
+
+const Build::BinaryImage *Build::load_binary_image(
+  const var::StringView name,
+  const var::StringView section) const {
+  const auto binary_name = get_binary_image_name(name, section);
+  ImageInfo image_info = build_image_info(name);
+  if (section.is_empty()) {
+    return decode_binary_image(binary_name, image_info);
+  }
+  auto section_list = image_info.section_list();
+  SectionImageInfo section_info = section_list.at(section);
+  return decode_binary_image(binary_name, section_info);
+}
+
+template <class Info>
+const Build::BinaryImage *
+Build::decode_binary_image(const var::StringView binary_name, Info &info) const {
+  if (info.is_binary()) {
+    return find_binary_image(binary_name);
+  }
+
+  // empty values and placeholders such as <base64> have no image
+  const var::StringView image = info.get_image();
+  if (image.is_empty() || image.find("<") == 0) {
+    return nullptr;
+  }
+
+  // the JSON can be shared with copies of the build so it isn't changed,
+  // the cached image is used while it was decoded from the same value
+  const json::JsonValue source = info.to_object().at("image");
+  auto is_decoded = [&](const BinaryImage &binary_image) {
+    return binary_image.source().is_valid()
+           && binary_image.source().to_string_view().data()
+                == source.to_string_view().data();
+  };
+  {
+    thread::Mutex::Guard mutex_guard(binary_image_mutex());
+    for (const auto &binary_image : m_binary_image_list) {
+      if (
+        binary_image.name().string_view() == binary_name
+        && is_decoded(binary_image)) {
+        return &binary_image;
+      }
+    }
+  }
+
+  // decoded without the lock, another thread may decode the same value
+  var::Data data = info.get_image_data();
+  thread::Mutex::Guard mutex_guard(binary_image_mutex());
+  BinaryImage &binary_image = get_binary_image_entry(binary_name);
+  if (is_decoded(binary_image) == false) {
+    // holding the source keeps its string from being reused by a new value
+    binary_image = BinaryImage().set_name(binary_name).set_source(source);
+    binary_image.data() = std::move(data);
+  }
+  return &binary_image;
 }
 
-Build &Build::set_image(const var::StringView name, const var::Data &image) {
-  build_image_info(name).set_image_data(image);
+var::NameString Build::get_binary_image_name(
+  const var::StringView name,
+  const var::StringView section) const {
+  var::NameString result = normalize_name(name);
+  if (section.is_empty() == false) {
+    result.append(".").append(section);
+  }
+  return result;
+}
+
+const Build::BinaryImage *
+Build::find_binary_image(const var::StringView name) const {
+  thread::Mutex::Guard mutex_guard(binary_image_mutex());
+  for (const auto &binary_image : m_binary_image_list) {
+    if (binary_image.name().string_view() == name) {
+      return &binary_image;
+    }
+  }
+  return nullptr;
+}
+
+Build::BinaryImage &
+Build::get_binary_image_entry(const var::StringView name) const {
+  for (auto &entry : m_binary_image_list) {
+    if (entry.name().string_view() == name) {
+      return entry;
+    }
+  }
+  m_binary_image_list.push_back(BinaryImage().set_name(name));
+  return m_binary_image_list.back();
+}
+
+void Build::store_binary_image(
+  const var::StringView name,
+  const var::View image) const {
+  // a copy is taken first, the image can be a view of the entry
+  const BinaryImage binary_image = BinaryImage().set_name(name).set_data(
+    var::Data(image));
+  thread::Mutex::Guard mutex_guard(binary_image_mutex());
+  get_binary_image_entry(name) = binary_image;
+}
+
+void Build::store_mapped_image(
+  const var::StringView name,
+  const var::View image) {
+  const BinaryImage binary_image
+    = BinaryImage().set_name(name).set_view(image).set_mapped(true);
+  thread::Mutex::Guard mutex_guard(binary_image_mutex());
+  get_binary_image_entry(name) = binary_image;
+}
+
+Build &Build::export_bundle(const fs::File &file) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  Timeline::Span span("export_bundle", "build");
+
+  // the manifest is a copy with the marker in place of every payload
+  // (the mirror of get_encoded_object()), base64 values left in it
+  // would be decoded over the mapped images by import_bundle(). The
+  // binary list can also hold images that are no longer in the build.
+  var::Vector<var::NameString> payload_name_list;
+  json::JsonObject build_object
+    = json::JsonObject().copy(to_object()).to_object();
+  json::JsonArray build_list = build_object.at("buildList").to_array();
+  for (u32 i = 0; i < build_list.count(); i++) {
+    ImageInfo image_info(build_list.at(i).to_object());
+    const auto name = image_info.get_name();
+    if (load_binary_image(name, "") != nullptr) {
+      payload_name_list.push_back(get_binary_image_name(name, ""));
+      image_info.set_image(binary_image_marker());
+    }
+    auto section_list = image_info.section_list();
+    for (auto &section : section_list) {
+      if (load_binary_image(name, section.key()) != nullptr) {
+        payload_name_list.push_back(get_binary_image_name(name, section.key()));
+        section.set_image(binary_image_marker());
+      }
+    }
+  }
+  API_RETURN_VALUE_IF_ERROR(*this);
+
+  // the list is complete, pointers into it stay valid from here
+  var::Vector<const BinaryImage *> payload_image_list;
+  for (const auto &payload_name : payload_name_list) {
+    payload_image_list.push_back(find_binary_image(payload_name));
+  }
+
+  json::JsonArray payload_list;
+  size_t payload_offset = 0;
+  for (const BinaryImage *binary_image : payload_image_list) {
+    const size_t size = binary_image->get_view().size();
+    payload_list.append(
+      json::JsonObject()
+        .insert("name", json::JsonString(binary_image->name().cstring()))
+        .insert("offset", json::JsonInteger(payload_offset))
+        .insert("size", json::JsonInteger(size)));
+    payload_offset += get_bundle_page_aligned(size);
+  }
+
+  JsonDocument document;
+  document.set_flags(JsonDocument::Flags::compact);
+  const var::String manifest = document.stringify(
+    json::JsonObject()
+      .insert("build", build_object)
+      .insert("payloads", payload_list));
+
+  bundle_header_t header = {};
+  memcpy(header.magic, bundle_magic, sizeof(header.magic));
+  header.version = bundle_version;
+  header.manifest_size = manifest.length();
+  header.payload_offset
+    = get_bundle_page_aligned(sizeof(header) + manifest.length());
+
+  // payloads start on a page so they can be mapped in place
+  file.write(var::View(header)).write(manifest);
+  write_bundle_padding(
+    file,
+    header.payload_offset - sizeof(header) - manifest.length());
+  for (const BinaryImage *binary_image : payload_image_list) {
+    const var::View image = binary_image->get_view();
+    file.write(image);
+    write_bundle_padding(
+      file,
+      get_bundle_page_aligned(image.size()) - image.size());
+  }
+
+  return *this;
+}
+
+Build &Build::import_bundle(const var::StringView path) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  Timeline::Span span("import_bundle", "build");
+
+  auto bundle_file = std::make_shared<MappedFile>(path);
+  API_RETURN_VALUE_IF_ERROR(*this);
+
+  const var::View header_view
+    = bundle_file->get_view(0, sizeof(bundle_header_t));
+  if (header_view.size() != sizeof(bundle_header_t)) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "bundle is too small", EINVAL);
+  }
+
+  bundle_header_t header;
+  memcpy(&header, header_view.to_const_void(), sizeof(header));
+  if (
+    memcmp(header.magic, bundle_magic, sizeof(header.magic)) != 0
+    || header.version != bundle_version) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "not a supported bundle", EINVAL);
+  }
+
+  const var::View manifest_view
+    = bundle_file->get_view(sizeof(header), header.manifest_size);
+  if (manifest_view.size() != header.manifest_size) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      *this,
+      "bundle manifest is truncated",
+      EINVAL);
+  }
+
+  const json::JsonObject manifest
+    = JsonDocument()
+        .from_string(var::StringView(
+          manifest_view.to_const_char(),
+          manifest_view.size()))
+        .to_object();
+  API_RETURN_VALUE_IF_ERROR(*this);
+
+  to_object() = manifest.at("build").to_object();
+  m_binary_image_list.clear();
+
+  const json::JsonArray payload_list = manifest.at("payloads").to_array();
+  for (u32 i = 0; i < payload_list.count(); i++) {
+    const json::JsonObject payload = payload_list.at(i).to_object();
+    const size_t size = payload.at("size").to_integer();
+    const var::View payload_view = bundle_file->get_view(
+      header.payload_offset + payload.at("offset").to_integer(),
+      size);
+    if (payload_view.size() != size) {
+      API_RETURN_VALUE_ASSIGN_ERROR(
+      *this,
+      "bundle payload is truncated",
+      EINVAL);
+    }
+    store_mapped_image(payload.at("name").to_string_view(), payload_view);
+  }
+
+  m_bundle_file = bundle_file;
   return *this;
 }
 
 Build &Build::sign(const crypto::Dsa &dsa) {
-  auto build_list = build_image_list();
-  for (auto build : build_list) {
-    build.sign(dsa);
+  const auto build_list = build_image_list();
+  for (auto image_info : build_list) {
+    if (image_info.is_signed()) {
+      continue;
+    }
+    const auto name = image_info.get_name();
+    const auto signed_data = sign_data(get_image(name), dsa);
+    set_image(name, signed_data);
+    image_info.set_size(signed_data.size()).set_signed(true);
+
+    const auto section_list = image_info.section_list();
+    for (auto section : section_list) {
+      if (section.is_signed()) {
+        continue;
+      }
+      const auto signed_section_data
+        = sign_data(get_section_image(name, section.key()), dsa);
+      set_section_image(name, section.key(), signed_section_data);
+      section.set_size(signed_section_data.size()).set_signed(true);
+    }
   }
   return *this;
 }
@@ -404,19 +1638,19 @@ Build &Build::insert_public_key(
 
   const auto location = image_info.get_secret_key_position();
   const auto size = image_info.get_secret_key_size();
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "public key location is " | NumberString(location, "0x%08x"));
-  CLOUD_PRINTER_TRACE("public key size is " | NumberString(size));
+  SERVICE_PRINTER_TRACE("public key size is " | NumberString(size));
 
   if (size != 64) {
-    CLOUD_PRINTER_TRACE("public key size must be 64");
+    SERVICE_PRINTER_TRACE("public key size must be 64");
     return *this;
   }
 
-  auto image_data = image_info.get_image_data();
+  auto image_data = get_image(image_info.get_name());
   ViewFile(image_data).seek(location).write(public_key);
   const auto key_string = public_key.to_string<GeneralString>();
-  CLOUD_PRINTER_TRACE("final key is " | key_string);
+  SERVICE_PRINTER_TRACE("final key is " | key_string);
 
   printer()
     .open_object("publicKey")
@@ -425,7 +1659,8 @@ Build &Build::insert_public_key(
     .key("size", NumberString(size))
     .close_object();
 
-  image_info.set_public_key(key_string).set_image_data(image_data);
+  image_info.set_public_key(key_string);
+  set_image(image_info.get_name(), image_data);
 
   return *this;
 }
@@ -442,18 +1677,18 @@ Build &Build::insert_secret_key(
   View secret_key_view
     = secret_key.size() ? secret_key : View(new_key.key256());
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "provided key size is " | NumberString(secret_key.size()));
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "generated key size is " | NumberString(new_key.key256().count()));
 
   const u32 location = image_info.get_secret_key_position();
   const u32 size = image_info.get_secret_key_size();
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "secret key location is " | NumberString(location, "0x%08x"));
-  CLOUD_PRINTER_TRACE("secret key size is " | NumberString(size));
+  SERVICE_PRINTER_TRACE("secret key size is " | NumberString(size));
 
-  Data image_data = image_info.get_image_data();
+  Data image_data = get_image(image_info.get_name());
 
   if (size != 32) {
     if (insert_pure_code_secret_key(image_data, secret_key_view) == false) {
@@ -464,9 +1699,10 @@ Build &Build::insert_secret_key(
   }
 
   const auto key_string = secret_key_view.to_string<GeneralString>();
-  CLOUD_PRINTER_TRACE("final key is " | key_string);
+  SERVICE_PRINTER_TRACE("final key is " | key_string);
 
-  image_info.set_secret_key(key_string).set_image_data(image_data);
+  image_info.set_secret_key(key_string);
+  set_image(image_info.get_name(), image_data);
 
   return *this;
 }
@@ -482,11 +1718,11 @@ bool Build::insert_pure_code_secret_key(
 
     const auto offset = View(image_data).find(compiled_key_view);
 
-    CLOUD_PRINTER_TRACE(
+    SERVICE_PRINTER_TRACE(
       "compiled key offset is " | NumberString(offset, "0x%08x"));
 
     if (offset == View::npos) {
-      CLOUD_PRINTER_TRACE("Nowhere to insert a pure code secret key");
+      SERVICE_PRINTER_TRACE("Nowhere to insert a pure code secret key");
       return false;
     }
 
@@ -497,7 +1733,7 @@ bool Build::insert_pure_code_secret_key(
       const u16 value = ((0xA0 + position)) | (0x23 << 8);
       const auto key_offset = image_key_view.find(View(value));
       if (key_offset == View::npos) {
-        CLOUD_PRINTER_TRACE(
+        SERVICE_PRINTER_TRACE(
           "Failed to insert key -- this should never happen "
           | NumberString(value, "%04x"));
         return false;
@@ -523,12 +1759,13 @@ void Build::interface_remove() {
   // is this an old-style build commit
   json::JsonArray array = at("buildList");
   if (array.count() && array.at(0).is_string()) {
-    CLOUD_PRINTER_TRACE("using legacy build list");
+    SERVICE_PRINTER_TRACE("using legacy build list");
     for (u32 i = 0; i < array.count(); i++) {
       api::ErrorGuard error_guard;
       const auto path = create_storage_path(array.at(i).to_string_view());
-      CLOUD_PRINTER_TRACE(
+      SERVICE_PRINTER_TRACE(
         "Removing legacy build storage " | path.string_view());
+      Governor::Request request;
       cloud().remove_storage_object(path.string_view());
     }
   } else {
@@ -536,75 +1773,305 @@ void Build::interface_remove() {
     for (const ImageInfo &build_image_info : list) {
       api::ErrorGuard error_guard;
       const auto path = create_storage_path(build_image_info.get_name());
-      CLOUD_PRINTER_TRACE("Removing build storage " | path.string_view());
+      SERVICE_PRINTER_TRACE("Removing build storage " | path.string_view());
+      Governor::Request request;
       cloud().remove_storage_object(path.string_view());
     }
   }
   API_RETURN_IF_ERROR();
 #endif
 
-  CLOUD_PRINTER_TRACE("Removing build document");
+  SERVICE_PRINTER_TRACE("Removing build document");
   Document::interface_remove();
 }
 
 void Build::interface_save() {
+  Memory::Operation memory_operation("save");
 
-  // upload the build images to storage /builds/project_id/build_id/arch/name
-  int count = 1;
+  // hashes are saved with the document so later builds can share objects
+  update_image_hashes();
+
+  class Upload {
+  public:
+    // the bytes that are encrypted and stored
+    View get_data() const {
+      return compressed().size() ? View(compressed()) : image();
+    }
 
-  Aes::Key key(
-    Aes::Key::Construct().set_key(get_key()).set_initialization_vector(
-      get_iv()));
+  private:
+    API_AC(Upload, Document::Path, path);
+    API_AC(Upload, var::View, image);
+    API_AC(Upload, var::Data, compressed);
+    API_AC(Upload, var::String, key);
+    API_AC(Upload, var::String, iv);
+  };
+
+  // update_image_hashes() decoded every image so the views stay valid
+  Vector<Upload> upload_list;
+  size_t total_size = 0;
+  size_t shared_count = 0;
+
+  auto add_upload = [&](auto &info, const StringView name, const View image) {
+    if (info.get_storage_path().is_empty() == false) {
+      shared_count++;
+      return;
+    }
+
+    info.set_compression("").set_compressed_size(0);
+    if (is_chunk_storage() == false) {
+      info.set_chunk_list(Vector<ChunkInfo>());
+      Upload upload = Upload()
+                        .set_path(create_storage_path(name))
+                        .set_image(image)
+                        .set_key(get_key())
+                        .set_iv(get_iv());
+      if (is_compressed_storage()) {
+        Timeline::Span span("compress", "build");
+        var::Data compressed = Compression().compress(image);
+        // images that don't get smaller are stored as they are
+        if (compressed.size() < image.size()) {
+          info.set_compression(Compression::name())
+            .set_compressed_size(compressed.size());
+          upload.compressed() = std::move(compressed);
+        }
+      }
+      upload_list.push_back(upload);
+      return;
+    }
+
+    Vector<ChunkInfo> chunk_list;
+    size_t offset = 0;
+    const auto chunk_size_list = get_chunk_size_list(image);
+    for (const size_t chunk_size : chunk_size_list) {
+      const View chunk = View(image).pop_front(offset).truncate(chunk_size);
+      const var::String hash(get_sha256_string(chunk).string_view());
+      chunk_list.push_back(ChunkInfo().set_hash(hash).set_size(chunk_size));
+      offset += chunk_size;
+
+      if (
+        m_stored_chunk_list.find_offset(hash) != m_stored_chunk_list.count()) {
+        shared_count++;
+        continue;
+      }
+
+      // each chunk is encrypted with a key derived from its contents
+      m_stored_chunk_list.push_back(hash);
+      upload_list.push_back(
+        Upload()
+          .set_path(create_chunk_storage_path(hash))
+          .set_image(chunk)
+          .set_key(hash)
+          .set_iv(get_chunk_initialization_vector(hash).string_view()));
+    }
+    info.set_chunk_list(chunk_list);
+  };
+
+  {
+    const auto list = get_build_image_list();
+    for (auto build_image_info : list) {
+      const auto build_name = build_image_info.get_name();
+      add_upload(build_image_info, build_name, get_image_view(build_name));
+
+      auto section_list = build_image_info.section_list();
+      for (auto &section : section_list) {
+        add_upload(
+          section,
+          build_name & "." & section.key(),
+          get_section_image_view(build_name, section.key()));
+      }
+    }
+    for (const auto &upload : upload_list) {
+      total_size += upload.get_data().size();
+    }
+  }
 
-  // get a copy of the build image list
-  const auto list = get_build_image_list();
   remove_build_image_data();
 
   DocumentAccess<Build>::interface_save();
   API_RETURN_IF_ERROR();
 
-  auto upload_image = [&](Data & data, const var::StringView name, size_t count, size_t list_count){
+  // upload the build images to storage /builds/project_id/build_id/arch/name
+  size_t uploaded_size = 0;
+  auto upload_file = [&](const Upload &upload, const fs::FileObject &file) {
+    Timeline::Span span("upload", "storage");
+    // progress is reported for all of the images rather than per object
+    const u32 percent
+      = total_size ? u32(u64(uploaded_size) * 100 / total_size) : 100;
+    Governor::Request request;
+    cloud_service().storage().create_object(
+      upload.path(),
+      file,
+      KeyString().format("%ld%% uploaded", long(percent)));
+    uploaded_size += upload.get_data().size();
+  };
 
-    Array<u8, 16> padding;
-    View padding_view(padding);
+  // images are encrypted as they are read so memory use doesn't
+  // grow with the image size
+  for (const auto &upload : upload_list) {
+    const Aes::Key key(
+      Aes::Key::Construct().set_key(upload.key()).set_initialization_vector(
+        upload.iv()));
+    EncryptStream encrypt_stream(upload.get_data(), key);
+    fs::LambdaFile encrypted_file;
+    encrypted_file.set_size(encrypt_stream.size())
+      .set_read_callback(
+        [&encrypt_stream](int location, var::View view) -> int {
+          return encrypt_stream.read(location, view);
+        });
+    upload_file(upload, encrypted_file);
+    API_RETURN_IF_ERROR();
+  }
 
-    data.append(padding_view.fill(0).truncate(Aes::get_padding(data.size())));
+  printer::Printer::Object upload_object(printer(), "upload");
+  printer()
+    .key("count", NumberString(upload_list.count()))
+    .key("sharedCount", NumberString(shared_count))
+    .key("size", NumberString(total_size));
+}
 
-    DataFile encrypted_file
-      = DataFile()
-          .reserve(data.size() + 16)
-          .write(
-            ViewFile(data),
-            AesCbcEncrypter()
-              .set_key256(key.key256())
-              .set_initialization_vector(key.initialization_vector()))
-          .move();
+Build &Build::reuse_storage(const Build &build) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (build.id().is_empty() || build.get_project_id() != get_project_id()) {
+    return *this;
+  }
 
-    cloud_service().storage().create_object(
-      create_storage_path(name),
-      encrypted_file.seek(0),
-      KeyString().format("%d of %d", count, list_count));
+  // chunks are stored by content so the build key doesn't matter
+  const auto build_list = build.build_image_list();
+  for (const auto &image_info : build_list) {
+    add_stored_chunks(image_info);
+    const auto section_list = image_info.section_list();
+    for (const auto &section : section_list) {
+      add_stored_chunks(section);
+    }
+  }
+
+  const auto storage_object_list = build.get_key().is_empty()
+                                     ? var::Vector<StorageObject>()
+                                     : build.get_storage_object_list();
+  if (storage_object_list.count() == 0) {
+    return *this;
+  }
+
+  update_image_hashes();
+
+  auto reuse = [&](auto &info) {
+    if (info.get_storage_path().is_empty() == false) {
+      return;
+    }
+    for (const auto &storage_object : storage_object_list) {
+      if (storage_object.hash() == info.get_hash()) {
+        info.set_storage_path(storage_object.path())
+          .set_storage_key(storage_object.key())
+          .set_storage_iv(storage_object.iv())
+          .set_compression(storage_object.compression())
+          .set_compressed_size(storage_object.compressed_size());
+        return;
+      }
+    }
   };
 
-  for (const ImageInfo &build_image_info : list) {
-    auto data = build_image_info.get_image_data();
-    const auto build_name = build_image_info.get_name();
+  const auto list = build_image_list();
+  for (auto image_info : list) {
+    reuse(image_info);
+    auto section_list = image_info.section_list();
+    for (auto &section : section_list) {
+      reuse(section);
+    }
+  }
+
+  return *this;
+}
+
+Build &Build::update_image_hashes() {
+  const auto list = build_image_list();
+  for (auto image_info : list) {
+    const auto name = image_info.get_name();
+    update_image_hash(image_info, get_image_view(name));
+    auto section_list = image_info.section_list();
+    for (auto &section : section_list) {
+      update_image_hash(section, get_section_image_view(name, section.key()));
+    }
+  }
+  return *this;
+}
+
+template <class Info>
+void Build::update_image_hash(Info &info, const var::View image) const {
+  if (image.size() == 0) {
+    // the image isn't available, keep what was saved
+    return;
+  }
+
+  const auto hash = calculate_hash(image);
+  if (hash.string_view() != info.get_hash()) {
+    // the image changed after it was matched with a stored object
+    info.set_hash(hash.string_view())
+      .set_storage_path("")
+      .set_storage_key("")
+      .set_storage_iv("")
+      .set_compression("")
+      .set_compressed_size(0);
+  }
+}
+
+var::Vector<Build::StorageObject> Build::get_storage_object_list() const {
+  var::Vector<StorageObject> result;
 
-    printer::Printer::Object build_objects(printer(), build_name);
+  // objects this build shares from older builds are passed along
+  auto add = [&](const auto &info, const var::StringView name) {
+    if (info.get_hash().is_empty()) {
+      return;
+    }
+    const bool is_shared = info.get_storage_path().is_empty() == false;
+    if (is_shared == false && info.chunk_list().count()) {
+      // stored only as chunks, reuse_storage() shares the chunks instead
+      return;
+    }
+    result.push_back(
+      StorageObject()
+        .set_hash(info.get_hash())
+        .set_path(
+          is_shared ? info.get_storage_path()
+                    : create_storage_path(name).string_view())
+        .set_key(is_shared ? info.get_storage_key() : get_key())
+        .set_iv(is_shared ? info.get_storage_iv() : get_iv())
+        .set_compression(info.get_compression())
+        .set_compressed_size(info.get_compressed_size()));
+  };
 
-    upload_image(data, build_name, count, list.count());
+  const auto list = build_image_list();
+  for (const auto &image_info : list) {
+    const auto name = image_info.get_name();
+    add(image_info, name);
+    const auto section_list = image_info.section_list();
+    for (const auto &section : section_list) {
+      add(section, name & "." & section.key());
+    }
+  }
+  return result;
+}
 
-    printer::Printer::Object sections_object(printer(), "sections");
-    const auto section_list = build_image_info.section_list();
-    size_t section_count = 1;
-    for(const auto & section: section_list){
-      auto data = section.get_image_data();
-      upload_image(data, build_name & "." & section.key(), section_count++, section_list.count());
+template <class Info> void Build::add_stored_chunks(const Info &info) {
+  const auto chunk_list = info.chunk_list();
+  for (const auto &chunk : chunk_list) {
+    const var::String hash(chunk.get_hash());
+    if (m_stored_chunk_list.find_offset(hash) == m_stored_chunk_list.count()) {
+      m_stored_chunk_list.push_back(hash);
     }
-    count++;
   }
 }
 
+Document::Path
+Build::create_chunk_storage_path(const var::StringView hash) const {
+  // the object name doesn't reveal the hash, which is the chunk key
+  return Document::Path("builds") / get_project_id() / "chunks"
+         / get_sha256_string(var::View(hash)).string_view();
+}
+
+var::String Build::calculate_hash(const var::View image) {
+  return var::String(get_sha256_string(image).string_view());
+}
+
 var::PathString Build::get_build_file_path(
   const var::StringView path,
   const var::StringView build) {
@@ -0,0 +1,306 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cstring>
+
+#include <crypto.hpp>
+#include <fs.hpp>
+#include <var.hpp>
+
+#include "service/BuildStream.hpp"
+
+using namespace service;
+
+DecryptStream::DecryptStream(
+  var::Data &image,
+  size_t size,
+  const var::StringView key,
+  const var::StringView initialization_vector)
+  : m_image(image), m_size(size), m_is_encrypted(key.is_empty() == false),
+    m_key(crypto::Aes::Key::Construct().set_key(key).set_initialization_vector(
+      initialization_vector)) {
+  m_initialization_vector = m_key.initialization_vector();
+}
+
+int DecryptStream::write(int location, const var::View cipher) {
+  if (size_t(location) != m_location) {
+    return -1;
+  }
+  m_location += cipher.size();
+
+  if (m_is_encrypted == false) {
+    // unencrypted images keep all of their bytes
+    append(cipher);
+    return int(cipher.size());
+  }
+
+  size_t offset = 0;
+  while (offset < cipher.size()) {
+    size_t page_size = chunk_size - m_chunk_count;
+    if (page_size > cipher.size() - offset) {
+      page_size = cipher.size() - offset;
+    }
+    memcpy(
+      m_chunk.data() + m_chunk_count,
+      cipher.to_const_u8() + offset,
+      page_size);
+    m_chunk_count += page_size;
+    offset += page_size;
+    if (decrypt(m_chunk_count & ~size_t(15)) == false) {
+      return -1;
+    }
+  }
+
+  return int(cipher.size());
+}
+
+var::GeneralString DecryptStream::get_hash() {
+  return var::View(m_sha256.output()).to_string<var::GeneralString>();
+}
+
+void DecryptStream::append(const var::View plain) {
+  m_image.append(plain);
+  m_sha256.update(plain);
+}
+
+bool DecryptStream::decrypt(size_t cipher_size) {
+  if (cipher_size == 0) {
+    return true;
+  }
+
+  fs::DataFile plain_file
+    = fs::DataFile()
+        .reserve(cipher_size)
+        .write(
+          fs::ViewFile(var::View(m_chunk).truncate(cipher_size)),
+          crypto::AesCbcDecrypter()
+            .set_key256(m_key.key256())
+            .set_initialization_vector(m_initialization_vector))
+        .move();
+  if (plain_file.data().size() != cipher_size) {
+    return false;
+  }
+
+  memcpy(
+    m_initialization_vector.data(),
+    m_chunk.data() + cipher_size - 16,
+    16);
+  m_chunk_count -= cipher_size;
+  memmove(m_chunk.data(), m_chunk.data() + cipher_size, m_chunk_count);
+
+  // the padding after the image size is dropped
+  const size_t remaining
+    = m_size > m_image.size() ? m_size - m_image.size() : 0;
+  append(var::View(plain_file.data())
+           .truncate(cipher_size < remaining ? cipher_size : remaining));
+  return true;
+}
+
+EncryptStream::EncryptStream(
+  const var::View image,
+  const crypto::Aes::Key &key)
+  : m_image(image), m_key(key) {
+  restart();
+}
+
+int EncryptStream::read(int location, var::View destination) {
+  if (size_t(location) != m_location) {
+    // the storage client only reads in order or starts over
+    if (location != 0) {
+      return -1;
+    }
+    restart();
+  }
+
+  size_t result = 0;
+  while (result < destination.size()) {
+    if (m_ring_count == 0 && fill() == 0) {
+      break;
+    }
+    const size_t tail = (m_ring_head + ring_size - m_ring_count) % ring_size;
+    size_t page_size = destination.size() - result;
+    if (page_size > m_ring_count) {
+      page_size = m_ring_count;
+    }
+    if (page_size > ring_size - tail) {
+      page_size = ring_size - tail;
+    }
+    memcpy(destination.to_u8() + result, m_ring.data() + tail, page_size);
+    m_ring_count -= page_size;
+    result += page_size;
+  }
+
+  m_location += result;
+  return int(result);
+}
+
+void EncryptStream::restart() {
+  m_initialization_vector = m_key.initialization_vector();
+  m_ring_head = 0;
+  m_ring_count = 0;
+  m_image_offset = 0;
+  m_location = 0;
+}
+
+size_t EncryptStream::fill() {
+  size_t result = 0;
+  while (ring_size - m_ring_count >= chunk_size
+         && m_image_offset < m_image.size()) {
+    size_t plain_size = m_image.size() - m_image_offset;
+    if (plain_size > chunk_size) {
+      plain_size = chunk_size;
+    }
+    memcpy(m_chunk.data(), m_image.to_const_u8() + m_image_offset, plain_size);
+    m_image_offset += plain_size;
+
+    // only the last chunk can be short
+    const size_t padding = crypto::Aes::get_padding(plain_size);
+    memset(m_chunk.data() + plain_size, 0, padding);
+    const size_t cipher_size = plain_size + padding;
+
+    fs::DataFile cipher_file
+      = fs::DataFile()
+          .reserve(cipher_size)
+          .write(
+            fs::ViewFile(var::View(m_chunk).truncate(cipher_size)),
+            crypto::AesCbcEncrypter()
+              .set_key256(m_key.key256())
+              .set_initialization_vector(m_initialization_vector))
+          .move();
+    const var::View cipher = cipher_file.data();
+    if (cipher.size() != cipher_size) {
+      return result;
+    }
+
+    memcpy(
+      m_initialization_vector.data(),
+      cipher.to_const_u8() + cipher_size - 16,
+      16);
+
+    // the head wraps so the copy can be split in two
+    const size_t first_size = cipher_size < ring_size - m_ring_head
+                                ? cipher_size
+                                : ring_size - m_ring_head;
+    memcpy(m_ring.data() + m_ring_head, cipher.to_const_u8(), first_size);
+    memcpy(
+      m_ring.data(),
+      cipher.to_const_u8() + first_size,
+      cipher_size - first_size);
+    m_ring_head = (m_ring_head + cipher_size) % ring_size;
+    m_ring_count += cipher_size;
+    result += cipher_size;
+  }
+  return result;
+}
+
+int ImageFieldStream::write(int location, const var::View view) {
+  if (size_t(location) != m_location) {
+    return -1;
+  }
+  m_location += view.size();
+
+  for (size_t i = 0; i < view.size(); i++) {
+    if (write_character(view.to_const_char()[i]) == false) {
+      m_is_invalid = true;
+      return -1;
+    }
+  }
+  return int(view.size());
+}
+
+var::KeyString ImageFieldStream::get_placeholder(size_t offset) {
+  return var::KeyString("<stream:")
+    .append(var::NumberString(offset).string_view())
+    .append(">");
+}
+
+bool ImageFieldStream::write_character(char c) {
+  switch (m_state) {
+  case State::json:
+    append_json(c);
+    if (c == '"') {
+      m_string.clear();
+      m_state = State::string;
+    } else if (c == ':') {
+      m_is_image_value = m_is_key_image;
+    } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+      m_is_key_image = false;
+      m_is_image_value = false;
+    }
+    if (m_state == State::string && m_is_image_value) {
+      m_is_image_value = false;
+      m_state = State::image_start;
+    }
+    return true;
+
+  case State::string:
+    append_json(c);
+    if (c == '\\') {
+      m_state = State::string_escape;
+    } else if (c == '"') {
+      m_is_key_image = m_string.string_view() == "image";
+      m_state = State::json;
+    } else if (m_string.length() < key_size) {
+      m_string.append(var::StringView(&c, 1));
+    }
+    return true;
+
+  case State::string_escape:
+    append_json(c);
+    m_state = State::string;
+    return true;
+
+  case State::image_start:
+    if (c == '"' || c == '<') {
+      // not base64, the value goes in the JSON
+      m_is_key_image = false;
+      m_state = State::string;
+      return write_character(c);
+    }
+    // the opening quote is already in the JSON
+    m_json.append(get_placeholder(m_image_list.count()).string_view())
+      .append("\"");
+    m_image_list.push_back(var::Data());
+    m_base64.clear();
+    m_state = State::image;
+    return write_character(c);
+
+  case State::image:
+    if (c == '"') {
+      m_is_key_image = false;
+      m_state = State::json;
+      return decode(m_base64.length());
+    }
+    if (c == '\\') {
+      m_state = State::image_escape;
+      return true;
+    }
+    m_base64.append(var::StringView(&c, 1));
+    if (m_base64.length() >= decode_size) {
+      return decode(decode_size);
+    }
+    return true;
+
+  case State::image_escape:
+    m_state = State::image;
+    if (c == '/') {
+      // JSON can escape the `/` in base64 as `\/`
+      m_base64.append("/");
+      return true;
+    }
+    // escaped line breaks wrap long base64 values, any other escape
+    // can't be part of base64
+    return c == 'n' || c == 'r' || c == 't';
+  }
+  return false;
+}
+
+bool ImageFieldStream::decode(size_t size) {
+  if (size % 4) {
+    return false;
+  }
+  const var::StringView input = m_base64.string_view();
+  m_image_list.back().append(
+    var::Base64().decode(input.get_substring_with_length(size)));
+  m_base64 = var::String(input.get_substring_at_position(size));
+  return true;
+}
@@ -0,0 +1,314 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <chrono.hpp>
+#include <json.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
+#include "service/Coalescer.hpp"
+#include "service/Governor.hpp"
+
+using namespace service;
+
+namespace {
+class GenericDocument : public DocumentAccess<GenericDocument> {
+public:
+  GenericDocument(const var::StringView path, const Id &id = "")
+    : DocumentAccess<GenericDocument>(path, id) {}
+};
+
+size_t find_key(
+  const var::Vector<var::KeyString> &list,
+  const var::StringView key) {
+  for (size_t i = 0; i < list.count(); i++) {
+    if (list.at(i).string_view() == key) {
+      return i;
+    }
+  }
+  return list.count();
+}
+} // namespace
+
+Coalescer::Coalescer(const Construct &options)
+  : Metrics::Source(
+    options.name().is_empty() ? var::StringView("coalescer")
+                              : options.name()),
+    m_window(options.window()) {
+  m_clock.start();
+}
+
+Coalescer::~Coalescer() { flush(); }
+
+Coalescer &Coalescer::update(const Document &document) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (document.id().is_empty()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      *this,
+      "only documents with an id can be coalesced",
+      EINVAL);
+  }
+
+  // the document may change after this call
+  const json::JsonObject fields
+    = json::JsonObject().copy(document.to_object()).to_object();
+
+  {
+    thread::Mutex::Guard mutex_guard(m_mutex);
+    const Entry key = Entry().set_path(document.path()).set_id(document.id());
+    size_t offset = m_entry_list.find_offset(key);
+    if (offset == m_entry_list.count()) {
+      // a new document has no cloud fields to compare with
+      m_entry_list.push_back(Entry(key)
+                               .set_existing(document.is_existing())
+                               .set_seeded(document.is_existing() == false));
+      offset = m_entry_list.count() - 1;
+    }
+
+    Entry &entry = m_entry_list.at(offset);
+    const bool was_pending = entry.is_pending();
+    json::JsonObject pending = entry.pending();
+    auto &removed_list = entry.removed_list();
+
+    const auto key_list = fields.get_key_list();
+    for (const auto &field_key : key_list) {
+      const size_t removed_offset = find_key(removed_list, field_key);
+      if (removed_offset < removed_list.count()) {
+        removed_list.remove(removed_offset);
+      }
+
+      const json::JsonValue value = fields.at(field_key);
+      if (is_equal(value, entry.written().at(field_key))) {
+        // reverted to the value that is already stored
+        pending.remove(field_key);
+      } else {
+        pending.insert(field_key, value);
+      }
+    }
+
+    // a field removed since the last update isn't written
+    const auto pending_key_list = pending.get_key_list();
+    for (const auto &pending_key : pending_key_list) {
+      if (fields.at(pending_key).is_valid() == false) {
+        pending.remove(pending_key);
+      }
+    }
+
+    const auto written_key_list = entry.written().get_key_list();
+    for (const auto &written_key : written_key_list) {
+      if (
+        fields.at(written_key).is_valid() == false
+        && find_key(removed_list, written_key) == removed_list.count()) {
+        removed_list.push_back(var::KeyString(written_key));
+        pending.remove(written_key);
+      }
+    }
+
+    entry.set_pending(pending);
+    if (was_pending == false && entry.is_pending()) {
+      entry.set_first_update(m_clock.milliseconds());
+    }
+    m_update_count++;
+  }
+
+  return flush_if_due();
+}
+
+Coalescer &Coalescer::flush_if_due() { return write_entries(true); }
+
+Coalescer &Coalescer::flush() { return write_entries(false); }
+
+Coalescer::Statistics Coalescer::get_statistics() const {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  u32 pending_count = 0;
+  for (const auto &entry : m_entry_list) {
+    pending_count += entry.is_pending() ? 1 : 0;
+  }
+  return Statistics()
+    .set_window(m_window.milliseconds())
+    .set_pending_count(pending_count)
+    .set_update_count(m_update_count)
+    .set_write_count(m_write_count)
+    .set_writes_avoided_count(
+      m_update_count > m_write_count ? m_update_count - m_write_count : 0)
+    .set_error_count(m_error_count);
+}
+
+Coalescer &Coalescer::write_entries(bool is_due_only) {
+  if (is_due_only) {
+    // update() doesn't wait for a write that another thread is making,
+    // due entries are written by a later call
+    thread::Mutex::Guard mutex_guard(m_mutex);
+    if (m_is_writing) {
+      return *this;
+    }
+  }
+
+  // the writes share the update mask of the store
+  thread::Mutex::Guard write_guard(m_write_mutex);
+
+  var::Vector<Entry> snapshot_list;
+  {
+    thread::Mutex::Guard mutex_guard(m_mutex);
+    m_is_writing = true;
+    const u32 now = m_clock.milliseconds();
+    for (auto &entry : m_entry_list) {
+      if (
+        entry.is_pending()
+        && (is_due_only == false
+            || (now - entry.first_update()) >= m_window.milliseconds())) {
+        // update() changes the entry in place, the write uses a copy
+        snapshot_list.push_back(
+          Entry(entry)
+            .set_pending(json::JsonObject().copy(entry.pending()).to_object())
+            .set_written(
+              json::JsonObject().copy(entry.written()).to_object()));
+      }
+    }
+  }
+
+  // the lock isn't held during network calls so update() doesn't wait
+  for (auto &snapshot : snapshot_list) {
+    const bool is_written = write(snapshot);
+
+    thread::Mutex::Guard mutex_guard(m_mutex);
+    if (is_written == false) {
+      m_error_count++;
+      continue;
+    }
+    m_write_count++;
+
+    const size_t offset = m_entry_list.find_offset(snapshot);
+    if (offset == m_entry_list.count()) {
+      continue;
+    }
+    Entry &entry = m_entry_list.at(offset);
+    entry.set_written(snapshot.written())
+      .set_existing(true)
+      .set_seeded(true);
+
+    // fields that changed again during the write stay pending
+    json::JsonObject pending = entry.pending();
+    const auto key_list = snapshot.pending().get_key_list();
+    for (const auto &field_key : key_list) {
+      if (is_equal(pending.at(field_key), snapshot.pending().at(field_key))) {
+        pending.remove(field_key);
+      }
+    }
+    auto &removed_list = entry.removed_list();
+    for (const auto &removed_key : snapshot.removed_list()) {
+      const size_t removed_offset
+        = find_key(removed_list, removed_key.string_view());
+      if (removed_offset < removed_list.count()) {
+        removed_list.remove(removed_offset);
+      }
+    }
+    if (entry.is_pending()) {
+      entry.set_first_update(m_clock.milliseconds());
+    }
+  }
+
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  m_is_writing = false;
+  return *this;
+}
+
+bool Coalescer::write(Entry &entry) {
+  const Document::Path path = Document::Path(entry.path()) / entry.id();
+  SERVICE_PRINTER_TRACE("coalesced write to " | path.string_view());
+
+  // an error belongs to this write, the entry stays pending and other
+  // entries are still written
+  api::ErrorScope error_scope;
+
+  if (entry.is_existing() && entry.is_seeded() == false) {
+    // the fields of the cloud document are needed to know which fields
+    // were removed locally, they are read once per document
+    GenericDocument document(entry.path(), entry.id());
+    if (document.is_existing()) {
+      entry.set_written(document.to_object());
+      // a field removed since the last update isn't written
+    const auto pending_key_list = pending.get_key_list();
+    for (const auto &pending_key : pending_key_list) {
+      if (fields.at(pending_key).is_valid() == false) {
+        pending.remove(pending_key);
+      }
+    }
+
+    const auto written_key_list = entry.written().get_key_list();
+      for (const auto &written_key : written_key_list) {
+        if (
+          entry.pending().at(written_key).is_valid() == false
+          && find_key(entry.removed_list(), written_key)
+               == entry.removed_list().count()) {
+          entry.removed_list().push_back(var::KeyString(written_key));
+        }
+      }
+    } else {
+      entry.set_existing(false);
+    }
+    API_RESET_ERROR();
+  }
+
+  // the written fields only change if the write succeeds
+  json::JsonObject written
+    = json::JsonObject().copy(entry.written()).to_object();
+  const auto key_list = entry.pending().get_key_list();
+  for (const auto &field_key : key_list) {
+    written.insert(field_key, entry.pending().at(field_key));
+  }
+  for (const auto &removed_key : entry.removed_list()) {
+    written.remove(removed_key.string_view());
+  }
+
+  if (entry.is_existing() == false) {
+    // the first write goes through the full get, create or patch sequence
+    GenericDocument document(entry.path());
+    document.to_object() = json::JsonObject().copy(written).to_object();
+    document.set_id(entry.id()).set_document_id(entry.id()).save();
+    if (is_error()) {
+      SERVICE_PRINTER_TRACE(
+        "coalesced write failed " | var::StringView(error().message()));
+      return false;
+    }
+  } else {
+    json::JsonObject patch
+      = json::JsonObject().copy(entry.pending()).to_object();
+    patch.insert(
+      "timestamp",
+      json::JsonInteger(DateTime::get_system_time().ctime()));
+
+    // masked fields that are not in the patch are removed
+    auto &mask = cloud_service().store().document_update_mask_fields();
+    mask.clear();
+    const auto patch_key_list = patch.get_key_list();
+    for (const auto &patch_key : patch_key_list) {
+      mask.push_back(var::String(patch_key));
+    }
+    for (const auto &removed_key : entry.removed_list()) {
+      mask.push_back(var::String(removed_key.string_view()));
+    }
+
+    {
+      Governor::Request request;
+      cloud_service().store().patch_document(path.string_view(), patch);
+    }
+    mask.clear();
+    if (is_error()) {
+      SERVICE_PRINTER_TRACE(
+        "coalesced write failed " | var::StringView(error().message()));
+      return false;
+    }
+  }
+
+  entry.set_written(written);
+  return true;
+}
+
+bool Coalescer::is_equal(const json::JsonValue &a, const json::JsonValue &b) {
+  if (a.is_valid() != b.is_valid()) {
+    return false;
+  }
+  JsonDocument document;
+  document.set_flags(JsonDocument::Flags::compact);
+  return document.stringify(a) == document.stringify(b);
+}
@@ -0,0 +1,177 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cerrno>
+#include <cstring>
+
+#include <var.hpp>
+
+#include "service/Compression.hpp"
+
+using namespace service;
+
+namespace {
+u32 read_u32(const u8 *data) {
+  u32 result;
+  memcpy(&result, data, sizeof(result));
+  return result;
+}
+
+u8 *write_length(u8 *output, size_t length) {
+  while (length >= 255) {
+    *output++ = 255;
+    length -= 255;
+  }
+  *output++ = u8(length);
+  return output;
+}
+} // namespace
+
+var::Data Compression::compress(const var::View input) const {
+  const u8 *data = input.to_const_u8();
+  const size_t size = input.size();
+
+  // positions are stored plus one so zero means empty
+  var::Vector<u32> table;
+  table.resize(size_t(1) << hash_bits);
+
+  // literals that don't compress grow by one byte per 255
+  var::Data result(size + size / 255 + 16);
+  u8 *const output_start = var::View(result).to_u8();
+  u8 *output = output_start;
+
+  auto write_sequence = [&](size_t literal_start,
+                            size_t literal_count,
+                            size_t offset,
+                            size_t match_length) {
+    const size_t match_code = match_length ? match_length - minimum_match : 0;
+    *output++ = u8(
+      ((literal_count < 15 ? literal_count : 15) << 4)
+      | (match_code < 15 ? match_code : 15));
+    if (literal_count >= 15) {
+      output = write_length(output, literal_count - 15);
+    }
+    memcpy(output, data + literal_start, literal_count);
+    output += literal_count;
+    if (match_length == 0) {
+      return;
+    }
+    *output++ = u8(offset);
+    *output++ = u8(offset >> 8);
+    if (match_code >= 15) {
+      output = write_length(output, match_code - 15);
+    }
+  };
+
+  size_t anchor = 0;
+  size_t position = 0;
+  while (position + minimum_match <= size) {
+    const u32 sequence = read_u32(data + position);
+    const u32 hash = (sequence * 2654435761U) >> (32 - hash_bits);
+    const u32 candidate = table.at(hash);
+    table.at(hash) = u32(position + 1);
+
+    if (
+      candidate == 0 || position - (candidate - 1) > maximum_offset
+      || read_u32(data + candidate - 1) != sequence) {
+      position++;
+      continue;
+    }
+
+    const size_t match_start = candidate - 1;
+    size_t match_length = minimum_match;
+    while (position + match_length < size
+           && data[match_start + match_length]
+                == data[position + match_length]) {
+      match_length++;
+    }
+
+    write_sequence(
+      anchor,
+      position - anchor,
+      position - match_start,
+      match_length);
+    position += match_length;
+    anchor = position;
+  }
+
+  write_sequence(anchor, size - anchor, 0, 0);
+  result.resize(size_t(output - output_start));
+  return result;
+}
+
+var::Data
+Compression::decompress(const var::View input, size_t size) const {
+  API_RETURN_VALUE_IF_ERROR(var::Data());
+  const u8 *data = input.to_const_u8();
+  const u8 *end = data + input.size();
+  var::Data result(size);
+  u8 *output = var::View(result).to_u8();
+  size_t output_size = 0;
+
+  auto read_length = [&](size_t length, bool &is_valid) {
+    if (length < 15) {
+      return length;
+    }
+    u8 value;
+    do {
+      if (data == end) {
+        is_valid = false;
+        return length;
+      }
+      value = *data++;
+      length += value;
+    } while (value == 255);
+    return length;
+  };
+
+  bool is_valid = true;
+  while (data < end && is_valid) {
+    const u8 token = *data++;
+    const size_t literal_count = read_length(token >> 4, is_valid);
+    if (
+      is_valid == false || literal_count > size_t(end - data)
+      || literal_count > size - output_size) {
+      is_valid = false;
+      break;
+    }
+    memcpy(output + output_size, data, literal_count);
+    data += literal_count;
+    output_size += literal_count;
+
+    if (data == end) {
+      // the last sequence only has literals
+      break;
+    }
+
+    if (end - data < 2) {
+      is_valid = false;
+      break;
+    }
+    const size_t offset = data[0] | (size_t(data[1]) << 8);
+    data += 2;
+    const size_t match_length
+      = read_length(token & 0x0f, is_valid) + minimum_match;
+    if (
+      is_valid == false || offset == 0 || offset > output_size
+      || match_length > size - output_size) {
+      is_valid = false;
+      break;
+    }
+
+    // matches can overlap the bytes they produce
+    const u8 *match = output + output_size - offset;
+    for (size_t i = 0; i < match_length; i++) {
+      output[output_size + i] = match[i];
+    }
+    output_size += match_length;
+  }
+
+  if (is_valid == false || output_size != size) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      var::Data(),
+      "compressed data is not valid",
+      EINVAL);
+  }
+
+  return result;
+}
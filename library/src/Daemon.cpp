@@ -0,0 +1,530 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <chrono.hpp>
+#include <json.hpp>
+#include <printer.hpp>
+#include <var.hpp>
+
+#if defined __link && !defined __win32
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define DAEMON_IS_AVAILABLE 1
+
+#if !defined MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#else
+#define DAEMON_IS_AVAILABLE 0
+#endif
+
+#include "service/Daemon.hpp"
+#include "service/Installer.hpp"
+#include "service/Project.hpp"
+
+using namespace service;
+
+namespace {
+
+class GenericDocument : public DocumentAccess<GenericDocument> {
+public:
+  GenericDocument(const var::StringView path, const Id &id = "")
+    : DocumentAccess<GenericDocument>(path, id) {}
+};
+
+#if DAEMON_IS_AVAILABLE
+int open_socket(const var::StringView path, struct sockaddr_un &address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  if (path.length() >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  ::memcpy(address.sun_path, path.data(), path.length());
+  return ::socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+// requests are small JSON objects, larger messages are rejected
+constexpr u32 maximum_message_size = 16 * 1024 * 1024;
+
+bool read_all(int fd, void *destination, size_t size) {
+  size_t offset = 0;
+  while (offset < size) {
+    const int result
+      = ::read(fd, static_cast<char *>(destination) + offset, size - offset);
+    if (result <= 0) {
+      // closed, failed or timed out
+      return false;
+    }
+    offset += result;
+  }
+  return true;
+}
+
+bool write_all(int fd, const void *source, size_t size) {
+  size_t offset = 0;
+  while (offset < size) {
+    const int result = ::send(
+      fd,
+      static_cast<const char *>(source) + offset,
+      size - offset,
+      MSG_NOSIGNAL);
+    if (result <= 0) {
+      return false;
+    }
+    offset += result;
+  }
+  return true;
+}
+
+// each message is a four byte big endian length then the JSON
+bool read_message(int fd, var::Data &message) {
+  u8 header[4];
+  if (read_all(fd, header, sizeof(header)) == false) {
+    return false;
+  }
+  const u32 size = (u32(header[0]) << 24) | (u32(header[1]) << 16)
+                   | (u32(header[2]) << 8) | u32(header[3]);
+  if (size > maximum_message_size) {
+    return false;
+  }
+  message.resize(size);
+  return read_all(fd, var::View(message).to_u8(), size);
+}
+
+bool write_message(int fd, const var::StringView value) {
+  const u32 size = value.length();
+  const u8 header[4]
+    = {u8(size >> 24), u8(size >> 16), u8(size >> 8), u8(size)};
+  return write_all(fd, header, sizeof(header))
+         && write_all(fd, value.data(), size);
+}
+
+json::JsonObject parse_message(const var::Data &message) {
+  return JsonDocument()
+    .from_string(StringView(message.view().to_const_char(), message.size()))
+    .to_object();
+}
+
+// the socket directory can't be shared with other users or be a link
+bool is_private_directory(const var::StringView directory) {
+  const var::PathString path(directory);
+  if (::mkdir(path.cstring(), 0700) < 0 && errno != EEXIST) {
+    return false;
+  }
+  struct stat info;
+  if (::lstat(path.cstring(), &info) < 0) {
+    return false;
+  }
+  return S_ISDIR(info.st_mode) && info.st_uid == ::geteuid()
+         && (info.st_mode & 077) == 0;
+}
+
+bool is_peer_owner(int fd) {
+#if defined __linux__
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == 0
+         && credentials.uid == ::geteuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  return ::getpeereid(fd, &uid, &gid) == 0 && uid == ::geteuid();
+#endif
+}
+
+void set_timeout(int fd, const chrono::MicroTime &timeout) {
+  struct timeval value = {};
+  value.tv_sec = timeout.seconds();
+  value.tv_usec = timeout.microseconds() % 1000000;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &value, sizeof(value));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &value, sizeof(value));
+}
+#endif
+
+var::StringView get_string(const json::JsonObject &options, const char *key) {
+  return options.at(key).to_string_view();
+}
+
+bool get_bool(const json::JsonObject &options, const char *key) {
+  return options.at(key).to_bool();
+}
+
+} // namespace
+
+Daemon::Daemon(const Construct &options)
+  : Metrics::Source("daemon"),
+    m_path(
+      options.path().is_empty() ? default_path()
+                                : var::PathString(options.path())),
+    m_connection(options.connection()),
+    m_maximum_cache_count(options.maximum_cache_count()),
+    m_cache_lifetime(options.cache_lifetime()),
+    m_request_timeout(options.request_timeout()) {
+
+#if DAEMON_IS_AVAILABLE
+  const var::StringView directory = fs::Path::parent_directory(m_path);
+  if (directory.is_empty() || is_private_directory(directory) == false) {
+    API_RETURN_ASSIGN_ERROR(
+      "the daemon socket must be in a directory only the owner can open",
+      EACCES);
+  }
+
+  struct sockaddr_un address;
+  m_socket = open_socket(m_path, address);
+  if (m_socket < 0) {
+    API_RETURN_ASSIGN_ERROR(m_path.cstring(), EINVAL);
+  }
+
+  {
+    // only a socket that refuses connections is left by an old daemon
+    struct sockaddr_un probe_address;
+    const int probe = open_socket(m_path, probe_address);
+    const int connect_result = ::connect(
+      probe,
+      reinterpret_cast<struct sockaddr *>(&probe_address),
+      sizeof(probe_address));
+    const int connect_error = errno;
+    ::close(probe);
+    if (connect_result == 0) {
+      API_RETURN_ASSIGN_ERROR("a daemon is already running", EADDRINUSE);
+    }
+    if (connect_error == ECONNREFUSED) {
+      ::unlink(m_path.cstring());
+    }
+  }
+
+  API_SYSTEM_CALL(
+    m_path.cstring(),
+    ::bind(
+      m_socket,
+      reinterpret_cast<struct sockaddr *>(&address),
+      sizeof(address)));
+  API_RETURN_IF_ERROR();
+  m_is_bound = true;
+  API_SYSTEM_CALL(m_path.cstring(), ::chmod(m_path.cstring(), 0600));
+  API_SYSTEM_CALL(m_path.cstring(), ::listen(m_socket, 8));
+#else
+  API_RETURN_ASSIGN_ERROR("daemon is not supported", ENOTSUP);
+#endif
+}
+
+Daemon::~Daemon() {
+#if DAEMON_IS_AVAILABLE
+  if (m_socket >= 0) {
+    ::close(m_socket);
+  }
+  if (m_is_bound) {
+    ::unlink(m_path.cstring());
+  }
+#endif
+}
+
+Daemon &Daemon::run() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+#if DAEMON_IS_AVAILABLE
+  printer().key("daemon", m_path.string_view());
+  while (m_is_stop == false) {
+    const int client = ::accept(m_socket, nullptr, nullptr);
+    if (client < 0) {
+      continue;
+    }
+
+    if (is_peer_owner(client) == false) {
+      SERVICE_PRINTER_TRACE("rejected a client of another user");
+      m_rejected_count++;
+      ::close(client);
+      continue;
+    }
+
+    // a stalled client can't hold up the daemon
+    set_timeout(client, m_request_timeout);
+    var::Data request_data;
+    if (read_message(client, request_data) == false) {
+      SERVICE_PRINTER_TRACE("dropped a client without a complete request");
+      m_rejected_count++;
+      ::close(client);
+      continue;
+    }
+
+    const json::JsonObject response
+      = process_request(parse_message(request_data));
+
+    write_message(
+      client,
+      JsonDocument()
+        .set_flags(JsonDocument::Flags::compact)
+        .stringify(response)
+        .string_view());
+    ::close(client);
+  }
+#endif
+  return *this;
+}
+
+json::JsonObject Daemon::process_request(const json::JsonObject &request) {
+  m_request_count++;
+  const StringView command = request.at("command").to_string_view();
+  const json::JsonObject options = request.at("options").to_object();
+  SERVICE_PRINTER_TRACE("daemon command " | command);
+
+  json::JsonObject result;
+  if (command == "install") {
+    result = install(options);
+  } else if (command == "saveBuild") {
+    result = save_build(options);
+  } else if (command == "getDocument") {
+    result = get_document(options);
+  } else if (command == "saveDocument") {
+    result = save_document(options);
+  } else if (command == "statistics") {
+    result = Metrics::get_metrics();
+  } else if (command == "stop") {
+    m_is_stop = true;
+  } else {
+    API_ASSIGN_ERROR("unknown command", EINVAL);
+  }
+
+  json::JsonObject response;
+  if (is_error()) {
+    response.insert("status", JsonString("error"))
+      .insert("error", JsonString(error().message()));
+    API_RESET_ERROR();
+  } else {
+    response.insert("status", JsonString("success"));
+  }
+  return response.insert("result", result);
+}
+
+json::JsonObject Daemon::install(const json::JsonObject &options) {
+  // an install can update documents such as the thing
+  clear_cache();
+  if (m_connection == nullptr) {
+    API_RETURN_VALUE_ASSIGN_ERROR(JsonObject(), "no connection", EINVAL);
+  }
+
+  // the link connection stays open between requests
+  if (m_connection->is_connected() == false) {
+    m_connection->reconnect(1, 500_milliseconds);
+    API_RETURN_VALUE_IF_ERROR(JsonObject());
+  }
+
+  Installer(m_connection)
+    .install(Installer::Install()
+               .set_project_id(get_string(options, "projectId"))
+               .set_team_id(get_string(options, "teamId"))
+               .set_url(get_string(options, "url"))
+               .set_project_path(get_string(options, "projectPath"))
+               .set_binary_path(get_string(options, "binaryPath"))
+               .set_build_name(get_string(options, "buildName"))
+               .set_version(get_string(options, "version"))
+               .set_destination(get_string(options, "destination"))
+               .set_architecture(get_string(options, "architecture"))
+               .set_sign_key_id(get_string(options, "signKeyId"))
+               .set_sign_key_password(get_string(options, "signKeyPassword"))
+               .set_secret_key(get_string(options, "secretKey"))
+               .set_application(get_bool(options, "application"))
+               .set_os(get_bool(options, "os"))
+               .set_startup(get_bool(options, "startup"))
+               .set_flash(get_bool(options, "flash"))
+               .set_kill(get_bool(options, "kill"))
+               .set_clean(get_bool(options, "clean"))
+               .set_force(get_bool(options, "force"))
+               .set_verify(get_bool(options, "verify"))
+               .set_append_hash(get_bool(options, "appendHash"))
+               .set_insert_key(get_bool(options, "insertKey"))
+               .set_reconnect(get_bool(options, "reconnect"))
+               .set_synchronize_thing(get_bool(options, "synchronizeThing")));
+
+  return JsonObject();
+}
+
+json::JsonObject Daemon::save_build(const json::JsonObject &options) {
+  const StringView project_path = get_string(options, "projectPath");
+  const PathString settings_path
+    = PathString(project_path) / Project::file_name();
+
+  Project project;
+  project.import_file(File(settings_path));
+  API_RETURN_VALUE_IF_ERROR(JsonObject());
+
+  project.save_build(
+    Project::SaveBuild()
+      .set_project_path(project_path)
+      .set_change_description(get_string(options, "changeDescription"))
+      .set_architecture(get_string(options, "architecture"))
+      .set_version(get_string(options, "version"))
+      .set_build_name(get_string(options, "buildName"))
+      .set_sign_key(get_string(options, "signKey"))
+      .set_sign_key_password(get_string(options, "signKeyPassword")));
+  API_RETURN_VALUE_IF_ERROR(JsonObject());
+
+  project.export_file(File(File::IsOverwrite::yes, settings_path));
+
+  // the project and build documents changed in the cloud
+  clear_cache();
+  return JsonObject().insert("id", JsonString(project.id().cstring()));
+}
+
+json::JsonObject Daemon::get_document(const json::JsonObject &options) {
+  const Document::Path path
+    = Document::Path(get_string(options, "path")) / get_string(options, "id");
+
+  const auto cached = get_cached(path);
+  if (cached.is_valid()) {
+    return cached;
+  }
+
+  GenericDocument document(
+    get_string(options, "path"),
+    Document::Id(get_string(options, "id")));
+  if (document.is_existing() == false) {
+    API_RETURN_VALUE_ASSIGN_ERROR(JsonObject(), path.cstring(), ENOENT);
+  }
+
+  update_cache(path, document.to_object());
+  return document.to_object();
+}
+
+json::JsonObject Daemon::save_document(const json::JsonObject &options) {
+  GenericDocument document(get_string(options, "path"));
+  document.to_object() = options.at("document").to_object();
+  document.set_id(document.get_document_id()).save();
+  API_RETURN_VALUE_IF_ERROR(JsonObject());
+
+  // the saved document can differ from the request, it is fetched again
+  remove_cached(Document::Path(get_string(options, "path")) / document.id());
+  return JsonObject().insert("id", JsonString(document.id().cstring()));
+}
+
+Daemon::Statistics Daemon::get_statistics() const {
+  return Statistics()
+    .set_request_count(m_request_count)
+    .set_cache_count(m_cache.count())
+    .set_cache_hit_count(m_cache_hit_count)
+    .set_cache_miss_count(m_cache_miss_count)
+    .set_cache_eviction_count(m_cache_eviction_count)
+    .set_rejected_count(m_rejected_count);
+}
+
+var::PathString Daemon::default_path() {
+#if DAEMON_IS_AVAILABLE
+  return var::PathString("/tmp/sl_service-")
+    .append(var::NumberString(::geteuid()).string_view())
+    .append("/service.sock");
+#else
+  return var::PathString();
+#endif
+}
+
+json::JsonObject Daemon::get_cached(const var::StringView path) {
+  const size_t offset
+    = m_cache.find_offset(CacheEntry(path, json::JsonObject()));
+  if (
+    offset < m_cache.count()
+    && m_cache.at(offset).expires_at()
+         <= DateTime::get_system_time().ctime()) {
+    m_cache.remove(offset);
+  } else if (offset < m_cache.count()) {
+    m_cache_hit_count++;
+    // move to the back so the least recently used entry is at the front
+    const CacheEntry entry = m_cache.at(offset);
+    m_cache.remove(offset).push_back(entry);
+    return entry.object();
+  }
+  m_cache_miss_count++;
+  return json::JsonObject();
+}
+
+void Daemon::update_cache(
+  const var::StringView path,
+  const json::JsonObject &object) {
+  remove_cached(path);
+  if (m_cache.count() >= m_maximum_cache_count && m_cache.count()) {
+    m_cache.remove(0);
+    m_cache_eviction_count++;
+  }
+  m_cache.push_back(
+    CacheEntry(path, json::JsonObject().copy(object))
+      .set_expires_at(
+        DateTime::get_system_time().ctime() + m_cache_lifetime.seconds()));
+}
+
+void Daemon::remove_cached(const var::StringView path) {
+  const size_t offset
+    = m_cache.find_offset(CacheEntry(path, json::JsonObject()));
+  if (offset < m_cache.count()) {
+    m_cache.remove(offset);
+  }
+}
+
+json::JsonObject Daemon::Client::request(
+  const var::StringView command,
+  const json::JsonObject &options) {
+#if DAEMON_IS_AVAILABLE
+  struct sockaddr_un address;
+  const int fd = open_socket(m_path, address);
+  if (fd < 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(JsonObject(), m_path.cstring(), EINVAL);
+  }
+
+  if (
+    ::connect(
+      fd,
+      reinterpret_cast<struct sockaddr *>(&address),
+      sizeof(address))
+    < 0) {
+    ::close(fd);
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      JsonObject(),
+      m_path.cstring(),
+      ECONNREFUSED);
+  }
+
+  var::Data response_data;
+  const bool is_complete
+    = write_message(
+        fd,
+        JsonDocument()
+          .set_flags(JsonDocument::Flags::compact)
+          .stringify(JsonObject()
+                       .insert("command", JsonString(command))
+                       .insert("options", options))
+          .string_view())
+      && read_message(fd, response_data);
+  ::close(fd);
+
+  if (is_complete == false) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      JsonObject(),
+      "no response from the daemon",
+      EIO);
+  }
+
+  const json::JsonObject response = parse_message(response_data);
+
+  if (response.at("status").to_string_view() != "success") {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      response.at("result").to_object(),
+      GeneralString(response.at("error").to_string_view()).cstring(),
+      EIO);
+  }
+  return response.at("result").to_object();
+#else
+  MCU_UNUSED_ARGUMENT(command);
+  MCU_UNUSED_ARGUMENT(options);
+  API_RETURN_VALUE_ASSIGN_ERROR(
+    JsonObject(),
+    "daemon is not supported",
+    ENOTSUP);
+#endif
+}
+
+bool Daemon::Client::is_running() {
+  api::ErrorScope error_scope;
+  request("statistics", JsonObject());
+  return is_success();
+}
@@ -7,12 +7,37 @@
 #include <var.hpp>
 
 #include "service/Document.hpp"
+#include "service/Governor.hpp"
+#include "service/Timeline.hpp"
 
 using namespace service;
 
+namespace {
+// the update time is sent as `currentDocument.updateTime` on the URL
+var::String get_precondition_query(const var::StringView update_time) {
+  var::String result("?currentDocument.updateTime=");
+  for (size_t i = 0; i < update_time.length(); i++) {
+    const char c = update_time.data()[i];
+    if (c == ':') {
+      result.append("%3A");
+    } else if (c == '+') {
+      result.append("%2B");
+    } else {
+      result.append(var::StringView(&c, 1));
+    }
+  }
+  return result;
+}
+} // namespace
+
 var::Vector<json::JsonObject>
 Document::list(var::StringView path, var::StringView mask) {
-  JsonObject response = cloud_service().store().list_documents(path, mask);
+  JsonObject response;
+  {
+    Timeline::Span span("list", "document");
+    Governor::Request request;
+    response = cloud_service().store().list_documents(path, mask);
+  }
   var::Vector<json::JsonObject> result;
   JsonArray documents = response.at("documents").to_array();
   for (u32 i = 0; i < documents.count(); i++) {
@@ -43,17 +68,21 @@ Document::Document(const var::StringView path, const Id &id)
       const auto info = FileSystem().get_info(id);
       if (info.is_file()) {
         interface_import_file(File(id));
-        CLOUD_PRINTER_TRACE("loaded file from " | id);
+        SERVICE_PRINTER_TRACE("loaded file from " | id);
       }
     } else {
       m_is_imported = false;
     }
   } else if (id.is_empty() == false) {
     api::ErrorScope es;
-    to_object() = cloud_service().store().get_document(Path(path) / id);
-    m_is_existing = is_success();
+    {
+      Timeline::Span span("get", "document");
+      Governor::Request request;
+      to_object() = read_document(Path(path) / id, m_update_time);
+      m_is_existing = is_success();
+    }
     m_is_imported = false;
-    CLOUD_PRINTER_TRACE(
+    SERVICE_PRINTER_TRACE(
       "document " | (Path(path) / id).string_view() | " exists? "
       | (m_is_existing ? "true" : "false"));
   }
@@ -62,15 +91,19 @@ Document::Document(const var::StringView path, const Id &id)
 void Document::update_is_existing() {
   if (m_is_imported) {
     // check to see if doc exists
-    CLOUD_PRINTER_TRACE("checking if " | get_document_id() | " exists");
+    SERVICE_PRINTER_TRACE("checking if " | get_document_id() | " exists");
     m_is_imported = false;
     if (get_document_id().is_empty() == false) {
-      CLOUD_PRINTER_TRACE(
+      SERVICE_PRINTER_TRACE(
         "Checking to see if " | get_document_id() | " exists in the cloud");
       api::ErrorGuard error_guard;
+      Timeline::Span span("exists", "document");
+      Governor::Request request;
+      // only whether the document exists is used, the update time is
+      // of the cloud document now and can't be a precondition
       api::ignore = cloud_service().store().get_document(get_path_with_id());
       m_is_existing = is_success();
-      CLOUD_PRINTER_TRACE(
+      SERVICE_PRINTER_TRACE(
         get_document_id() | " exists? " | (m_is_existing ? "true" : "false"));
     }
   }
@@ -79,20 +112,34 @@ void Document::update_is_existing() {
 void Document::interface_remove() {
   update_is_existing();
   if (is_existing()) {
+    Timeline::Span span("remove", "document");
+    Governor::Request request;
     cloud_service().store().remove_document(get_path_with_id());
     m_is_existing = false;
+    m_update_time = Timestamp();
   }
 }
 
 void Document::interface_save() {
   API_RETURN_IF_ERROR();
+  m_conflict = Conflict();
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "saving document to cloud " | path().string_view() | " id: "
     | get_document_id());
+
+  if (
+    m_is_precondition && m_is_imported
+    && get_document_id().is_empty() == false) {
+    // an imported file has no update time to compare with
+    API_RETURN_ASSIGN_ERROR(
+      "a conditional save needs a document loaded from the cloud",
+      EINVAL);
+  }
+
   update_is_existing();
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     "is existing? "
     | (is_existing() ? StringView("true") : StringView("false")));
 
@@ -105,7 +152,7 @@ void Document::interface_save() {
   }
 
   if (get_team_id() == "") {
-    CLOUD_PRINTER_TRACE("no team specified, ensure `team` entry");
+    SERVICE_PRINTER_TRACE("no team specified, ensure `team` entry");
     // this will ensure 'team' is present in the object
     // get_team_id() can be "" if not present or if ""
     set_team_id("");
@@ -116,25 +163,35 @@ void Document::interface_save() {
     || get_permissions() == "searchable");
 
   if (get_document_id().is_empty() || !is_existing()) {
-    CLOUD_PRINTER_TRACE("document path is " | path().string_view());
-    CLOUD_PRINTER_TRACE("creating new document with id: " | get_document_id());
-    const auto result = cloud_service().store().create_document(
-      path().string_view(),
-      to_object(),
-      get_document_id());
-
-    CLOUD_PRINTER_TRACE("new document id is " | result);
+    SERVICE_PRINTER_TRACE("document path is " | path().string_view());
+    SERVICE_PRINTER_TRACE("creating new document with id: " | get_document_id());
+    const auto result = [&]() {
+      Timeline::Span span("create", "document");
+      Governor::Request request;
+      return cloud_service().store().create_document(
+        path().string_view(),
+        to_object(),
+        get_document_id());
+    }();
+
+    SERVICE_PRINTER_TRACE("new document id is " | result);
     if (result != "") {
       // once document is uploaded it should be modified to include the id
       m_id = result;
     } else {
-      CLOUD_PRINTER_TRACE("there was an error creating the document");
+      SERVICE_PRINTER_TRACE("there was an error creating the document");
       JsonObject error = JsonDocument()
                            .from_string(cloud_service().store().error_string())
                            .to_object();
       if (
         error.at("error").to_object().at("status").to_string()
         == "ALREADY_EXISTS") {
+        if (m_is_precondition) {
+          // another writer created the document since it was loaded
+          API_RESET_ERROR();
+          load_conflict();
+          return;
+        }
         API_RETURN_ASSIGN_ERROR("", EEXIST);
       } else {
         API_RETURN_ASSIGN_ERROR("", EIO);
@@ -144,13 +201,99 @@ void Document::interface_save() {
   }
 
   // add keys from object to update mask
-  CLOUD_PRINTER_TRACE("patching document with id " | id());
+  SERVICE_PRINTER_TRACE("patching document with id " | id());
   cloud_service().store().document_update_mask_fields().clear();
   set_document_id(id());
-  cloud_service().store().patch_document(
-    get_path_with_id().string_view(),
-    to_object());
-  return;
+
+  // a document that was just created has no update time yet
+  const bool is_precondition = m_is_precondition && is_existing();
+  if (is_precondition && m_update_time.is_empty()) {
+    API_RETURN_ASSIGN_ERROR(
+      "reload the document before a conditional save",
+      EINVAL);
+  }
+
+  var::String patch_path(get_path_with_id().string_view());
+  if (is_precondition) {
+    SERVICE_PRINTER_TRACE("precondition update time " | m_update_time);
+    patch_path += get_precondition_query(m_update_time);
+  }
+
+  {
+    Timeline::Span span("patch", "document");
+    Governor::Request request;
+    cloud_service().store().patch_document(
+      patch_path.string_view(),
+      to_object());
+  }
+
+  if (is_error()) {
+    if (is_precondition && is_precondition_failed()) {
+      API_RESET_ERROR();
+      load_conflict();
+    }
+    return;
+  }
+
+  // the store doesn't return the patched document, the next conditional
+  // save needs the document to be loaded again (no extra read here)
+  m_is_existing = true;
+  m_update_time = Timestamp();
+}
+
+void Document::interface_save_if_unchanged() {
+  m_is_precondition = true;
+  interface_save();
+  m_is_precondition = false;
+}
+
+bool Document::is_precondition_failed() {
+  const JsonObject error
+    = JsonDocument()
+        .from_string(cloud_service().store().error_string())
+        .to_object();
+  return error.at("error").to_object().at("status").to_string_view()
+         == "FAILED_PRECONDITION";
+}
+
+void Document::load_conflict() {
+  SERVICE_PRINTER_TRACE("document " | get_path_with_id() | " was modified");
+  {
+    api::ErrorScope error_scope;
+    Timeline::Span span("get_conflict", "document");
+    Governor::Request request;
+    Timestamp update_time;
+    m_conflict.set_snapshot(read_document(get_path_with_id(), update_time))
+      .set_update_time(update_time);
+  }
+  API_RETURN_ASSIGN_ERROR(
+    "document was modified since it was loaded",
+    conflict_error_number());
+}
+
+json::JsonObject
+Document::read_document(const var::StringView path, Timestamp &update_time) {
+  // get_document() converts the fields and drops the document metadata.
+  // A GET of the document path through list_documents() returns the
+  // Firestore resource as it is, `updateTime` included.
+  const JsonObject document = cloud_service().store().list_documents(path, "");
+  if (is_error()) {
+    update_time = Timestamp();
+    return JsonObject();
+  }
+  update_time = Timestamp(document.at("updateTime").to_string_view());
+  return cloud::CloudMap(document).to_json();
+}
+
+Document &Document::refresh_from_conflict() {
+  if (m_conflict.is_valid()) {
+    to_object() = m_conflict.snapshot();
+    m_update_time = m_conflict.update_time();
+    m_id = get_document_id();
+    m_is_existing = true;
+    m_conflict = Conflict();
+  }
+  return *this;
 }
 
 void Document::interface_import_file(const fs::File &file) {
@@ -0,0 +1,219 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cerrno>
+
+#include <chrono.hpp>
+#include <json.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
+#include "service/Governor.hpp"
+
+using namespace service;
+
+namespace {
+// governors this thread holds a request on, a nested request on the same
+// governor doesn't wait. Deeper nesting isn't tracked and waits.
+constexpr u32 governor_held_size = 8;
+thread_local const Governor *governor_held_list[governor_held_size];
+thread_local u32 governor_held_count = 0;
+
+bool is_governor_held(const Governor *governor) {
+  const u32 count = governor_held_count < governor_held_size
+                      ? governor_held_count
+                      : governor_held_size;
+  for (u32 i = 0; i < count; i++) {
+    if (governor_held_list[i] == governor) {
+      return true;
+    }
+  }
+  return false;
+}
+
+u64 get_timestamp() {
+  // 64-bit microseconds don't wrap like a u32 timer
+  const auto now = chrono::ClockTime::get_system_time(
+    chrono::ClockTime::ClockId::monotonic);
+  return u64(now.seconds()) * 1000000ULL + u64(now.nanoseconds()) / 1000ULL;
+}
+} // namespace
+
+Governor::Governor(const var::StringView name) : Metrics::Source(name) {
+  m_tokens = m_limits.burst();
+  m_window = m_limits.minimum_window();
+  m_refill_time = get_timestamp();
+}
+
+Governor &Governor::default_governor() {
+  static Governor governor;
+  return governor;
+}
+
+Governor &Governor::set_limits(const Limits &limits) {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  m_limits = limits;
+  if (m_tokens > m_limits.burst()) {
+    m_tokens = m_limits.burst();
+  }
+  if (m_window < m_limits.minimum_window()) {
+    m_window = m_limits.minimum_window();
+  }
+  if (m_window > m_limits.maximum_window()) {
+    m_window = m_limits.maximum_window();
+  }
+  m_cond.broadcast();
+  return *this;
+}
+
+Governor::Limits Governor::limits() const {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  return m_limits;
+}
+
+Governor::Status Governor::get_status() const {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  return Status()
+    .set_rate(m_limits.rate())
+    .set_burst(m_limits.burst())
+    .set_minimum_window(m_limits.minimum_window())
+    .set_maximum_window(m_limits.maximum_window())
+    .set_latency_target(m_limits.latency_target().milliseconds())
+    .set_window(static_cast<u32>(m_window))
+    .set_in_flight(m_in_flight)
+    .set_tokens(static_cast<u32>(m_tokens))
+    .set_request_count(m_request_count)
+    .set_congestion_count(m_congestion_count)
+    .set_throttle_count(m_throttle_count)
+    .set_average_latency(
+      m_request_count ? (m_total_latency / m_request_count) / 1000 : 0);
+}
+
+bool Governor::is_congestion_error(int error_number) {
+  switch (error_number) {
+  case EIO:
+  case EAGAIN:
+  case EBUSY:
+  case ETIMEDOUT:
+  case ECONNRESET:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Governor::acquire(Request::Type type) {
+  bool is_throttled = false;
+  while (1) {
+    u32 token_wait = 0;
+    {
+      thread::Mutex::Guard mutex_guard(m_mutex);
+      refill();
+      const bool is_window_open = type == Request::Type::stream
+                                  || m_in_flight < static_cast<u32>(m_window);
+      if (is_window_open && m_tokens >= 1.0f) {
+        m_tokens -= 1.0f;
+        if (type == Request::Type::request) {
+          m_in_flight++;
+        }
+        if (is_throttled) {
+          m_throttle_count++;
+        }
+        return;
+      }
+
+      is_throttled = true;
+      if (is_window_open == false) {
+        // release() signals when a request leaves the window
+        m_cond.wait();
+        continue;
+      }
+
+      // the bucket refills at a known rate, wait for the next token
+      const u32 rate = m_limits.rate() ? m_limits.rate() : 1;
+      token_wait
+        = static_cast<u32>((1.0f - m_tokens) * 1000000.0f / rate) + 1;
+    }
+    chrono::wait(chrono::MicroTime(token_wait));
+  }
+}
+
+void Governor::release(
+  Request::Type type,
+  const chrono::MicroTime &latency,
+  bool is_congested) {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  if (type == Request::Type::stream) {
+    // a stream stays open for as long as it is used, the latency isn't
+    // a measure of the backend
+    return;
+  }
+
+  if (m_in_flight) {
+    m_in_flight--;
+  }
+  m_cond.broadcast();
+  m_request_count++;
+  m_total_latency += latency.microseconds();
+
+  if (is_congested || latency > m_limits.latency_target()) {
+    m_congestion_count++;
+    decrease_window();
+    return;
+  }
+
+  // additive increase: one request per window of successful requests
+  m_window += 1.0f / m_window;
+  if (m_window > m_limits.maximum_window()) {
+    m_window = m_limits.maximum_window();
+  }
+}
+
+void Governor::refill() {
+  const u64 now = get_timestamp();
+  const u64 elapsed = now - m_refill_time;
+  m_refill_time = now;
+  m_tokens += elapsed * 1.0f * m_limits.rate() / 1000000.0f;
+  if (m_tokens > m_limits.burst()) {
+    m_tokens = m_limits.burst();
+  }
+}
+
+void Governor::decrease_window() {
+  m_window = m_window / 2.0f;
+  if (m_window < m_limits.minimum_window()) {
+    m_window = m_limits.minimum_window();
+  }
+}
+
+Governor::Request::Request(Governor &governor, Type type)
+  : m_governor(governor), m_type(type),
+    m_is_nested(type == Type::request && is_governor_held(&governor)),
+    m_is_error_on_entry(api::ExecutionContext::is_error()) {
+  if (m_is_nested) {
+    // the outer request already holds a place in the window
+    return;
+  }
+  m_governor.acquire(m_type);
+  if (m_type == Type::request) {
+    if (governor_held_count < governor_held_size) {
+      governor_held_list[governor_held_count] = &m_governor;
+    }
+    governor_held_count++;
+  }
+  m_timer.start();
+}
+
+Governor::Request::~Request() {
+  if (m_is_nested) {
+    return;
+  }
+  m_timer.stop();
+  if (m_type == Type::request) {
+    // requests are scoped, this is the last governor that was added
+    governor_held_count--;
+  }
+  const bool is_congested
+    = !m_is_error_on_entry && api::ExecutionContext::is_error()
+      && is_congestion_error(api::ExecutionContext::error().error_number());
+  m_governor.release(m_type, m_timer.micro_time(), is_congested);
+}
@@ -11,7 +11,9 @@
 
 #include "service/Installer.hpp"
 #include "service/Keys.hpp"
+#include "service/Memory.hpp"
 #include "service/Thing.hpp"
+#include "service/Timeline.hpp"
 
 using namespace service;
 
@@ -20,6 +22,7 @@ Installer::Installer(sos::Link *link_connection)
 
 Installer &Installer::install(const Install &options) {
   API_RETURN_VALUE_IF_ERROR(*this);
+  Memory::Operation memory_operation("install");
 
   if (connection()->is_connected_and_is_not_bootloader()) {
     set_architecture(connection()->info().architecture());
@@ -48,7 +51,7 @@ Installer &Installer::install(const Install &options) {
 
     // is this a cloud ID install - check arch later
     if (!options.project_id().is_empty() || !options.url().is_empty()) {
-      CLOUD_PRINTER_TRACE("resolve arch later");
+      SERVICE_PRINTER_TRACE("resolve arch later");
     } else if (architecture().is_empty()) {
       API_RETURN_VALUE_ASSIGN_ERROR(
         *this,
@@ -132,15 +135,36 @@ void Installer::install_id(const Install &options) {
 }
 
 void Installer::install_binary(const Install &options) {
-  CLOUD_PRINTER_TRACE("install binary at " | options.binary_path());
+  SERVICE_PRINTER_TRACE("install binary at " | options.binary_path());
   API_RETURN_IF_ERROR();
 
-  if (fs::Path::suffix(options.binary_path()) == "json") {
+  const auto binary_suffix = fs::Path::suffix(options.binary_path());
+  if (binary_suffix == "json" || binary_suffix == Build::bundle_suffix()) {
     Build b = Build(Build::Construct().set_binary_path(options.binary_path()));
     set_project_name(String(b.get_name()));
     return install_build(b, options);
   }
 
+  if (binary_suffix == "elf") {
+    Build b = Build(Build::Construct()
+                      .set_binary_path(options.binary_path())
+                      .set_build_name(options.build_name())
+                      .set_architecture(architecture()));
+    API_RETURN_IF_ERROR();
+    if (b.get_type().is_empty()) {
+      // ELF files outside of a project don't have a type
+      b.set_type(
+        options.is_application() ? Build::application_type()
+                                 : Build::os_type());
+    }
+    set_project_name(String(b.get_name()));
+    // the build has one image, its name is chosen by the import
+    return install_build(
+      b,
+      Install(options).set_build_name(
+        b.build_image_list().at(0).get_name()));
+  }
+
   // check if the binary is an elf file
   if (FileSystem().exists(options.binary_path()) == false) {
     API_RETURN_ASSIGN_ERROR(
@@ -148,7 +172,7 @@ void Installer::install_binary(const Install &options) {
       EINVAL);
   }
 
-  CLOUD_PRINTER_TRACE("load image from binary path");
+  SERVICE_PRINTER_TRACE("load image from binary path");
   DataFile image = DataFile()
                      .write(File(options.binary_path()))
                      .set_flags(OpenMode::read_write())
@@ -156,7 +180,7 @@ void Installer::install_binary(const Install &options) {
                      .move();
 
   if (options.is_application()) {
-    CLOUD_PRINTER_TRACE("binary is an application");
+    SERVICE_PRINTER_TRACE("binary is an application");
     const auto source_image_info = Appfs().get_info(options.binary_path());
 
     if (source_image_info.is_valid() == false) {
@@ -171,43 +195,45 @@ void Installer::install_binary(const Install &options) {
   }
 
   if (options.is_os()) {
-    CLOUD_PRINTER_TRACE("install OS image from binary");
+    SERVICE_PRINTER_TRACE("install OS image from binary");
     return install_os_image(Build(Build::Construct()), image, options);
   }
 }
 
 void Installer::install_path(const Install &options) {
   API_RETURN_IF_ERROR();
-  CLOUD_PRINTER_TRACE("installing from path " & options.project_path());
+  SERVICE_PRINTER_TRACE("installing from path " & options.project_path());
 
   Build b(Build::Construct()
             .set_project_path(options.project_path())
             .set_build_name(options.build_name())
-            .set_architecture(architecture()));
+            .set_architecture(architecture())
+            .set_import_cache(true)
+            .set_parallel_import(options.is_parallel_import()));
 
   if (is_error()) {
-    CLOUD_PRINTER_TRACE("error constructing build. aborting");
+    SERVICE_PRINTER_TRACE("error constructing build. aborting");
     return;
   }
 
-  CLOUD_PRINTER_TRACE("setting installer project id to " | b.get_project_id());
+  SERVICE_PRINTER_TRACE("setting installer project id to " | b.get_project_id());
   set_project_id(b.get_project_id());
   set_project_name(fs::Path::name(options.project_path()));
-  CLOUD_PRINTER_TRACE("setting installer project name to " | project_name());
+  SERVICE_PRINTER_TRACE("setting installer project name to " | project_name());
 
   if (
     b.decode_build_type() == Build::Type::application
     && !options.is_application()) {
-    CLOUD_PRINTER_TRACE("project type != application");
+    SERVICE_PRINTER_TRACE("project type != application");
     API_RETURN_ASSIGN_ERROR("app type mismatch", false);
   }
 
   if (b.decode_build_type() == Build::Type::os && !options.is_os()) {
-    CLOUD_PRINTER_TRACE("project type != os");
+    SERVICE_PRINTER_TRACE("project type != os");
     API_RETURN_ASSIGN_ERROR("os type mismatch", false);
   }
 
-  CLOUD_PRINTER_TRACE("installing the build");
+  SERVICE_PRINTER_TRACE("installing the build");
   install_build(b, options);
 }
 
@@ -323,21 +349,21 @@ void Installer::update_os(const Install &options) {
 
 void Installer::install_build(Build &build, const Install &options) {
   API_RETURN_IF_ERROR();
-  CLOUD_PRINTER_TRACE("Installing build type " | build.get_type());
+  SERVICE_PRINTER_TRACE("Installing build type " | build.get_type());
 
   if (build.decode_build_type() == Build::Type::application) {
-    CLOUD_PRINTER_TRACE("installing application build");
+    SERVICE_PRINTER_TRACE("installing application build");
     install_application_build(build, options);
     return;
   }
 
   if (build.decode_build_type() == Build::Type::os) {
-    CLOUD_PRINTER_TRACE("installing os build");
+    SERVICE_PRINTER_TRACE("installing os build");
     install_os_build(build, options);
     return;
   }
 
-  CLOUD_PRINTER_TRACE("build type was not recognized " | build.get_type());
+  SERVICE_PRINTER_TRACE("build type was not recognized " | build.get_type());
 }
 
 void Installer::install_application_build(
@@ -364,7 +390,7 @@ void Installer::install_application_build(
     printer().key("hash", View(hash).to_string<KeyString>());
   }
 
-  CLOUD_PRINTER_TRACE("installing application image");
+  SERVICE_PRINTER_TRACE("installing application image");
   install_application_image(
     image.seek(0),
     Install(options).set_version(build.get_version()));
@@ -375,7 +401,7 @@ void Installer::install_os_build(Build &build, const Install &options) {
   // insert secret key
   if (options.is_insert_key()) {
 
-    CLOUD_PRINTER_TRACE("inserting secret key");
+    SERVICE_PRINTER_TRACE("inserting secret key");
     /*
      * Options for the key in preferential order
      *
@@ -390,7 +416,7 @@ void Installer::install_os_build(Build &build, const Install &options) {
      */
 
     StringView existing_secret_key = options.secret_key();
-    CLOUD_PRINTER_TRACE("existing key is `" | options.secret_key() | "`");
+    SERVICE_PRINTER_TRACE("existing key is `" | options.secret_key() | "`");
 
     StringView thing_team = connection()->info().team_id();
     if (thing_team.is_empty()) {
@@ -416,7 +442,7 @@ void Installer::install_os_build(Build &build, const Install &options) {
     }
 
     if (existing_secret_key.is_empty() && !options.is_rekey_thing()) {
-      CLOUD_PRINTER_TRACE("getting secret key from cloud");
+      SERVICE_PRINTER_TRACE("getting secret key from cloud");
       Thing thing(Sys::Info(connection()->info().sys_info()));
       if (thing.is_existing() == false) {
         // no thing there
@@ -424,10 +450,10 @@ void Installer::install_os_build(Build &build, const Install &options) {
       }
 
       existing_secret_key = thing.get_secret_key();
-      CLOUD_PRINTER_TRACE("got secret key `" | options.secret_key() | "`");
+      SERVICE_PRINTER_TRACE("got secret key `" | options.secret_key() | "`");
     }
 
-    CLOUD_PRINTER_TRACE("using key `" | existing_secret_key | "`");
+    SERVICE_PRINTER_TRACE("using key `" | existing_secret_key | "`");
     // if existing_secret_key secret key is empty, insert_secret_key() generates
     // a key
     build.insert_secret_key(
@@ -489,7 +515,8 @@ void Installer::install_os_build(Build &build, const Install &options) {
     API_RETURN_IF_ERROR();
   }
 
-  if (fs::Path::suffix(options.destination()) == "json") {
+  const auto destination_suffix = fs::Path::suffix(options.destination());
+  if (destination_suffix == "json") {
     Link::Path link_path(options.destination(), connection()->driver());
 
     build.remove_other_build_images(options.build_name());
@@ -506,8 +533,33 @@ void Installer::install_os_build(Build &build, const Install &options) {
     }
   }
 
-  DataFile image;
-  image.data() = build.get_image(options.build_name());
+  if (destination_suffix == Build::bundle_suffix()) {
+    Link::Path link_path(options.destination(), connection()->driver());
+
+    build.remove_other_build_images(options.build_name());
+
+    if (link_path.is_host_path()) {
+      build.export_bundle(File(File::IsOverwrite::yes, link_path.path()));
+
+      printer().key("destination", link_path.path_description());
+      return;
+    } else {
+      API_RETURN_ASSIGN_ERROR(
+        "cannot save bundle export to device (use `host@` prefix)",
+        EINVAL);
+    }
+  }
+
+  // the image is only copied if the hash is appended, otherwise it is
+  // read from the build (or straight from a mapped bundle)
+  const ViewFile image_view(build.get_image_view(options.build_name()));
+  DataFile image_copy;
+  if (options.is_append_hash()) {
+    image_copy.data() = build.get_image(options.build_name());
+  }
+  const FileObject &image = options.is_append_hash()
+                              ? static_cast<const FileObject &>(image_copy)
+                              : image_view;
 
   const auto signature_info = sos::Auth::get_signature_info(image);
   if (signature_info.signature().is_valid()) {
@@ -516,8 +568,8 @@ void Installer::install_os_build(Build &build, const Install &options) {
     const auto section_list
       = build.build_image_info(options.build_name()).get_section_list();
     for (const auto &section : section_list) {
-      DataFile section_image;
-      section_image.data() = section.get_image_data();
+      const ViewFile section_image(
+        build.get_section_image_view(options.build_name(), section.key()));
       const auto section_signature_info
         = sos::Auth::get_signature_info(section_image);
       if (section_signature_info.signature().is_valid()) {
@@ -528,7 +580,7 @@ void Installer::install_os_build(Build &build, const Install &options) {
 
   if (options.is_append_hash()) {
     const crypto::Sha256::Hash hash
-      = crypto::Sha256::append_aligned_hash(image);
+      = crypto::Sha256::append_aligned_hash(image_copy);
     printer().key("osHash", View(hash).to_string<KeyString>());
   }
 
@@ -570,7 +622,7 @@ void Installer::install_application_image(
   const fs::FileObject &image,
   const Install &options) {
 
-  CLOUD_PRINTER_TRACE("check flash available");
+  SERVICE_PRINTER_TRACE("check flash available");
   const bool is_flash_available
     = !options.destination().is_empty()
         ? false
@@ -611,7 +663,7 @@ void Installer::install_application_image(
     = DataFile(OpenMode::append_read_write()).write(image.seek(0)).move();
 
   // check if a signature is required
-  CLOUD_PRINTER_TRACE("check if signature is required");
+  SERVICE_PRINTER_TRACE("check if signature is required");
   const auto is_signature_required
     = !options.destination().is_empty()
         ? false
@@ -622,7 +674,7 @@ void Installer::install_application_image(
   if (
     options.sign_key_id().is_empty() && options.default_sign_key_id().is_empty()
     && is_signature_required) {
-    CLOUD_PRINTER_TRACE("no key provided, but a signature is required");
+    SERVICE_PRINTER_TRACE("no key provided, but a signature is required");
     const auto signature_info = sos::Auth::get_signature_info(image.seek(0));
     if (signature_info.signature().is_valid() == false) {
 
@@ -676,7 +728,7 @@ void Installer::install_application_image(
   }
 
   if (is_save_locally) {
-    CLOUD_PRINTER_TRACE("save locally");
+    SERVICE_PRINTER_TRACE("save locally");
     save_image_locally(
       Build(Build::Construct()),
       image_copy.seek(0),
@@ -691,11 +743,11 @@ void Installer::install_application_image(
     && (options.destination().is_empty() || (options.destination().find("/app") == 0))
     && Appfs(connection()->driver()).is_ram_available() == false) {
     // no RAM and no Flash
-    CLOUD_PRINTER_TRACE("no flash or ram");
+    SERVICE_PRINTER_TRACE("no flash or ram");
     API_RETURN_ASSIGN_ERROR("device@/app/.install", ENOENT);
   }
 
-  CLOUD_PRINTER_TRACE("check is running " & project_name());
+  SERVICE_PRINTER_TRACE("check is running " & project_name());
   int app_pid
     = sos::TaskManager("", connection()->driver()).get_pid(project_name());
   if (options.is_kill()) {
@@ -710,9 +762,9 @@ void Installer::install_application_image(
   }
 
   if (options.is_clean()) {
-    CLOUD_PRINTER_TRACE("clean applications");
+    SERVICE_PRINTER_TRACE("clean applications");
     clean_application();
-    CLOUD_PRINTER_TRACE("clean applications complete");
+    SERVICE_PRINTER_TRACE("clean applications complete");
   }
 
   printer().object("appfsAttributes", attributes);
@@ -721,26 +773,29 @@ void Installer::install_application_image(
     API_RETURN_ASSIGN_ERROR("not connected", EIO);
   }
 
-  CLOUD_PRINTER_TRACE("start install");
+  SERVICE_PRINTER_TRACE("start install");
   printer().set_progress_key("installing");
   chrono::ClockTimer transfer_timer;
   transfer_timer.start();
-  sos::Appfs(
-    Appfs::Construct()
-      .set_executable(true)
-      .set_overwrite(true)
-      .set_mount(
-        options.destination().is_empty() ? "/app" : options.destination())
-      .set_name(attributes.name()),
-    connection()->driver())
-    .append(image_copy.seek(0), printer().progress_callback());
+  {
+    Timeline::Span span("appfs_append", "installer");
+    sos::Appfs(
+      Appfs::Construct()
+        .set_executable(true)
+        .set_overwrite(true)
+        .set_mount(
+          options.destination().is_empty() ? "/app" : options.destination())
+        .set_name(attributes.name()),
+      connection()->driver())
+      .append(image_copy.seek(0), printer().progress_callback());
+  }
   transfer_timer.stop();
   printer().set_progress_key("progress");
 
   if (is_success()) {
     print_transfer_info(image, transfer_timer);
   } else {
-    CLOUD_PRINTER_TRACE("failed to install");
+    SERVICE_PRINTER_TRACE("failed to install");
     switch (error().error_number()) {
     case ENOSPC:
       API_RETURN_ASSIGN_ERROR("no space left on the target", ENOSPC);
@@ -761,7 +816,7 @@ void Installer::install_os_image(
   API_RETURN_IF_ERROR();
 
   if (!options.destination().is_empty()) {
-    CLOUD_PRINTER_TRACE("save build image locally");
+    SERVICE_PRINTER_TRACE("save build image locally");
     save_image_locally(build, image, Install(options).set_os());
     return;
   }
@@ -769,16 +824,19 @@ void Installer::install_os_image(
   {
     Printer::Object po(printer(), "bootloader");
     if (!connection()->is_bootloader()) {
-      CLOUD_PRINTER_TRACE("invoke the bootloader");
+      SERVICE_PRINTER_TRACE("invoke the bootloader");
       // bootloader must be invoked
-      connection()->reset_bootloader();
+      {
+        Timeline::Span span("reset_bootloader", "installer");
+        connection()->reset_bootloader();
+      }
       chrono::wait(options.delay());
       // now reconnect to the device
 
       reconnect(options);
 
     } else {
-      CLOUD_PRINTER_TRACE("connected to bootloader");
+      SERVICE_PRINTER_TRACE("connected to bootloader");
     }
 
     const bool is_signature_required = connection()->is_signature_required();
@@ -811,14 +869,17 @@ void Installer::install_os_image(
     ClockTimer transfer_timer;
     printer().set_progress_key("installing");
     transfer_timer.start();
-    CLOUD_PRINTER_TRACE("start installing the OS");
-    connection()->update_os(
-      Link::UpdateOs()
-        .set_image(&(image.seek(0)))
-        .set_flash_path(options.flash_device())
-        .set_bootloader_retry_count(options.retry_reconnect_count())
-        .set_printer(&printer())
-        .set_verify(options.is_verify()));
+    SERVICE_PRINTER_TRACE("start installing the OS");
+    {
+      Timeline::Span span("update_os", "installer");
+      connection()->update_os(
+        Link::UpdateOs()
+          .set_image(&(image.seek(0)))
+          .set_flash_path(options.flash_device())
+          .set_bootloader_retry_count(options.retry_reconnect_count())
+          .set_printer(&printer())
+          .set_verify(options.is_verify()));
+    }
 
     transfer_timer.stop();
     printer().set_progress_key("progress");
@@ -838,7 +899,8 @@ void Installer::install_os_image(
 }
 
 void Installer::reconnect(const Install &options) {
-  CLOUD_PRINTER_TRACE(String().format(
+  Timeline::Span span("reconnect", "installer");
+  SERVICE_PRINTER_TRACE(String().format(
     "reconnect %d retries at %dms intervals",
     options.retry_reconnect_count(),
     options.delay().milliseconds()));
@@ -866,20 +928,20 @@ void Installer::save_image_locally(
 
   API_ASSERT(options.destination().is_empty() == false);
 
-  CLOUD_PRINTER_TRACE("saving image to " + options.destination());
+  SERVICE_PRINTER_TRACE("saving image to " + options.destination());
   Link::Path link_path(options.destination(), connection()->driver());
   Link::FileSystem link_filesystem(link_path.driver());
 
   if (link_path.is_host_path()) {
-    CLOUD_PRINTER_TRACE("dest path is on local host");
+    SERVICE_PRINTER_TRACE("dest path is on local host");
   } else {
-    CLOUD_PRINTER_TRACE("dest path is on target device");
+    SERVICE_PRINTER_TRACE("dest path is on target device");
   }
   const auto info = link_filesystem.exists(link_path.path())
                       ? link_filesystem.get_info(link_path.path())
                       : FileInfo();
 
-  CLOUD_PRINTER_TRACE(
+  SERVICE_PRINTER_TRACE(
     link_path.path() | GeneralString(" is dest a directory ")
     | (info.is_directory() ? "true" : "false"));
 
@@ -913,7 +975,7 @@ void Installer::save_image_locally(
     printer()
       .key("path", link_path.prefix() | destination)
       .key("size", NumberString(image.size()));
-    CLOUD_PRINTER_TRACE("save binary file at path " & destination);
+    SERVICE_PRINTER_TRACE("save binary file at path " & destination);
     // hash for image was previously added
     Link::File(
       File::IsOverwrite::yes,
@@ -937,12 +999,12 @@ void Installer::save_image_locally(
           = fs::Path::no_suffix(destination) & image_info.key() & ".bin";
         Printer::Object image_object(printer(), image_info.key());
 
-        DataFile data_file;
-        data_file.data() = image_info.get_image_data();
+        const ViewFile data_file(
+          build.get_section_image_view(options.build_name(), image_info.key()));
 
         printer()
           .key("path", link_path.prefix() | section_destination)
-          .key("size", NumberString(data_file.data().size()));
+          .key("size", NumberString(data_file.size()));
 
         Link::File(
           File::IsOverwrite::yes,
@@ -997,20 +1059,20 @@ Installer &Installer::clean_application(const var::StringView name) {
       });
 
 
-  CLOUD_PRINTER_TRACE("unlink " | unlink_flash_app);
+  SERVICE_PRINTER_TRACE("unlink " | unlink_flash_app);
   while (fs.exists(unlink_flash_app)) {
     fs.remove(unlink_flash_app);
   }
 
-  CLOUD_PRINTER_TRACE("unlink " | unlink_ram_app);
+  SERVICE_PRINTER_TRACE("unlink " | unlink_ram_app);
   while (fs.exists(unlink_ram_app)) {
     fs.remove(unlink_ram_app);
   }
 
   cond.set_asserted();
-  CLOUD_PRINTER_TRACE("wait progress");
+  SERVICE_PRINTER_TRACE("wait progress");
   progress_thread.join();
-  CLOUD_PRINTER_TRACE("Done");
+  SERVICE_PRINTER_TRACE("Done");
   return *this;
 }
 
@@ -7,21 +7,28 @@
 #include <thread.hpp>
 #include <var.hpp>
 
+#include "service/Governor.hpp"
 #include "service/Job.hpp"
+#include "service/Memory.hpp"
+#include "service/Timeline.hpp"
 
 using namespace service;
 
 json::JsonValue
 Job::publish(const JsonValue &input, const chrono::MicroTime &timeout) {
+  Timeline::Span span("publish", "job");
+  Memory::Operation memory_operation("publish");
 
   Path object_path = Path("jobs") / get_document_id();
 
   // does the job exists
-  Job::Object job_object
-    = cloud_service()
-        .database()
-        .get_value(object_path, cloud::Cloud::IsRequestShallow(true))
-        .to_object();
+  Job::Object job_object = [&]() {
+    Governor::Request request;
+    return cloud_service()
+      .database()
+      .get_value(object_path, cloud::Cloud::IsRequestShallow(true))
+      .to_object();
+  }();
 
   if (job_object.is_valid()) {
     ClockTimer timeout_timer;
@@ -32,11 +39,14 @@ Job::publish(const JsonValue &input, const chrono::MicroTime &timeout) {
     IOValue input_value("", crypto_key, input);
 
     timeout_timer.restart();
-    KeyString input_id = cloud_service().database().create_object(
-      Path(object_path) / "input",
-      input_value.get_value());
+    KeyString input_id = [&]() {
+      Governor::Request request;
+      return cloud_service().database().create_object(
+        Path(object_path) / "input",
+        input_value.get_value());
+    }();
     if (input_id.is_empty()) {
-      CLOUD_PRINTER_TRACE(
+      SERVICE_PRINTER_TRACE(
         "Failed to create object " + cloud_service().database().traffic());
       return json::JsonNull();
     }
@@ -46,10 +56,14 @@ Job::publish(const JsonValue &input, const chrono::MicroTime &timeout) {
     // wait for result to post
     do {
 
-      object
-        = cloud_service().database().get_value(Path(object_path) / "output");
+      {
+        Governor::Request request;
+        object
+          = cloud_service().database().get_value(Path(object_path) / "output");
+      }
       if (object.at(input_id).is_valid()) {
         // job is complete -- delete the output
+        Governor::Request request;
         cloud_service().database().remove_object(
           Path(object_path) / "output" / input_id);
         return IOValue("", object.at(input_id)).decrypt_value(crypto_key);
@@ -63,10 +77,13 @@ Job::publish(const JsonValue &input, const chrono::MicroTime &timeout) {
 }
 
 bool Job::ping(const var::StringView id) {
-  cloud_service().database().get_value(
-    Path("jobs") / id,
-    NullFile(),
-    cloud::Cloud::IsRequestShallow(true));
+  {
+    Governor::Request request;
+    cloud_service().database().get_value(
+      Path("jobs") / id,
+      NullFile(),
+      cloud::Cloud::IsRequestShallow(true));
+  }
   bool result = is_success();
   API_RESET_ERROR();
   return result;
@@ -75,6 +92,7 @@ bool Job::ping(const var::StringView id) {
 void Job::IOValue::encrypt_value(
   const json::JsonValue &value,
   const crypto::Aes::Key &key) {
+  Timeline::Span span("encrypt", "crypto");
 
   var::String string_value
     = JsonDocument().set_flags(JsonDocument::Flags::compact).stringify(value);
@@ -98,6 +116,7 @@ void Job::IOValue::encrypt_value(
 }
 
 json::JsonValue Job::IOValue::decrypt_value(const crypto::Aes::Key &key) const {
+  Timeline::Span span("decrypt", "crypto");
 
   // iv is 16 bytes -- 32 characters
   const StringView iv_string = get_initialization_vector();
@@ -120,7 +139,11 @@ Job::Server::~Server() {
   if (id().is_empty() == false) {
     // delete job
     const Path job_path = Path("jobs") / id();
-    cloud_service().database().remove_object(job_path.string_view());
+    {
+      Governor::Request request;
+      cloud_service().database().remove_object(job_path.string_view());
+    }
+    Governor::Request request;
     cloud_service().store().remove_document(job_path.string_view());
   }
 }
@@ -137,10 +160,13 @@ Job::Server::start(const var::StringView type, const Job &job_document) {
 
   m_id = job.get_document_id();
 
-  cloud_service().database().create_object(
-    "jobs",
-    Job::Object().set_type(type),
-    job.get_document_id());
+  {
+    Governor::Request request;
+    cloud_service().database().create_object(
+      "jobs",
+      Job::Object().set_type(type),
+      job.get_document_id());
+  }
 
   if (is_success()) {
     m_id = job.get_document_id();
@@ -159,6 +185,9 @@ Job::Server::start(const var::StringView type, const Job &job_document) {
       return is_stop() == false ? view.size() : -1;
     });
 
+  // the listener is open until the job is done so it doesn't hold a
+  // place in the governor window
+  Governor::Request request(Governor::Request::Type::stream);
   cloud_service().database().listen(job_path, listen_file);
 
   return *this;
@@ -168,25 +197,32 @@ void Job::Server::process_input(const json::JsonValue &data) {
   if (data.is_valid() && data.is_object()) {
     const Path path = Path("jobs") / id();
 
-    Job::Object object
-      = cloud_service().database().get_value(path.string_view()).to_object();
+    Job::Object object = [&]() {
+      Governor::Request request;
+      return cloud_service().database().get_value(path.string_view()).to_object();
+    }();
 
     auto input_list = object.get_input();
 
     for (const auto &input : input_list) {
 
       if (callback()) {
+        Timeline::Span span("process_input", "job");
 
         JsonValue output = callback()(
           context(),
           object.get_type(),
           input_list.at(input.key()).decrypt_value(crypto_key()));
 
-        cloud_service().database().create_object(
-          Path(path) / "output",
-          Job::IOValue("", crypto_key(), output).get_value(),
-          input.key());
+        {
+          Governor::Request request;
+          cloud_service().database().create_object(
+            Path(path) / "output",
+            Job::IOValue("", crypto_key(), output).get_value(),
+            input.key());
+        }
 
+        Governor::Request request;
         cloud_service().database().remove_object(
           Path(path) / "input" / input.key());
       }
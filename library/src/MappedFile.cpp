@@ -0,0 +1,68 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cerrno>
+
+#include <fs.hpp>
+#include <var.hpp>
+
+#include "service/MappedFile.hpp"
+
+#if MAPPED_FILE_IS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace service;
+
+MappedFile::MappedFile(const var::StringView path) {
+  API_RETURN_IF_ERROR();
+  const var::PathString path_string(path);
+#if MAPPED_FILE_IS_MMAP
+  const int fd = ::open(path_string.cstring(), O_RDONLY);
+  if (fd < 0) {
+    API_RETURN_ASSIGN_ERROR(path_string.cstring(), errno);
+  }
+
+  struct stat stat_info;
+  if (::fstat(fd, &stat_info) < 0) {
+    const int error_number = errno;
+    ::close(fd);
+    API_RETURN_ASSIGN_ERROR(path_string.cstring(), error_number);
+  }
+
+  const size_t size = static_cast<size_t>(stat_info.st_size);
+  if (size > 0) {
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      const int error_number = errno;
+      ::close(fd);
+      API_RETURN_ASSIGN_ERROR(path_string.cstring(), error_number);
+    }
+    m_mapping = mapping;
+    m_view = var::View(m_mapping, size);
+  }
+
+  // the mapping stays valid after the descriptor is closed
+  ::close(fd);
+#else
+  m_data = fs::DataFile().write(fs::File(path_string)).data();
+  m_view = var::View(m_data);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if MAPPED_FILE_IS_MMAP
+  if (m_mapping != nullptr) {
+    ::munmap(m_mapping, m_view.size());
+  }
+#endif
+}
+
+var::View MappedFile::get_view(size_t offset, size_t size) const {
+  if (offset > m_view.size() || size > m_view.size() - offset) {
+    return var::View();
+  }
+  return var::View(m_view).pop_front(offset).truncate(size);
+}
@@ -0,0 +1,214 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include <json.hpp>
+#include <printer.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
+#include "service/Memory.hpp"
+
+using namespace service;
+
+namespace {
+// constant initialized so operator new works before main()
+std::atomic<size_t> memory_current_bytes(0);
+std::atomic<size_t> memory_peak_bytes(0);
+std::atomic<size_t> memory_allocation_count(0);
+
+// each running operation tracks its own peak in a slot
+constexpr size_t memory_operation_slot_count = 16;
+std::atomic<bool> memory_operation_is_active[memory_operation_slot_count];
+std::atomic<size_t> memory_operation_peak_bytes[memory_operation_slot_count];
+std::atomic<size_t> memory_operation_active_count(0);
+
+size_t acquire_operation_slot(size_t start_bytes) {
+  for (size_t i = 0; i < memory_operation_slot_count; i++) {
+    bool is_active = false;
+    if (memory_operation_is_active[i].compare_exchange_strong(
+          is_active,
+          true)) {
+      memory_operation_peak_bytes[i] = start_bytes;
+      memory_operation_active_count++;
+      return i;
+    }
+  }
+  return memory_operation_slot_count;
+}
+} // namespace
+
+Memory::Operation::Operation(const char *name)
+  : m_name(name), m_start_bytes(memory_current_bytes.load()),
+    m_start_allocation_count(memory_allocation_count.load()),
+    m_slot(acquire_operation_slot(m_start_bytes)) {}
+
+Memory::Operation::~Operation() {
+  const size_t peak = peak_bytes();
+  if (m_slot < memory_operation_slot_count) {
+    memory_operation_active_count--;
+    memory_operation_is_active[m_slot] = false;
+  }
+
+  if (is_enabled() == false) {
+    return;
+  }
+
+  const auto usage
+    = Memory::instance().record(m_name, peak, allocation_count());
+  if (printer().verbose_level() >= printer::Printer::Level::debug) {
+    printer().object(
+      var::KeyString("memory.").append(m_name),
+      usage,
+      printer::Printer::Level::debug);
+  }
+}
+
+size_t Memory::Operation::peak_bytes() const {
+  if (m_slot == memory_operation_slot_count) {
+    return 0;
+  }
+  const size_t peak = memory_operation_peak_bytes[m_slot].load();
+  return peak > m_start_bytes ? peak - m_start_bytes : 0;
+}
+
+size_t Memory::Operation::allocation_count() const {
+  return memory_allocation_count.load() - m_start_allocation_count;
+}
+
+size_t Memory::current_bytes() { return memory_current_bytes.load(); }
+size_t Memory::peak_bytes() { return memory_peak_bytes.load(); }
+size_t Memory::allocation_count() { return memory_allocation_count.load(); }
+
+Memory &Memory::instance() {
+  static Memory value;
+  return value;
+}
+
+json::JsonObject Memory::get_metrics() const {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  return json::JsonObject()
+    .insert(
+      "isEnabled",
+      is_enabled() ? json::JsonValue(json::JsonTrue())
+                   : json::JsonValue(json::JsonFalse()))
+    .insert("currentBytes", json::JsonInteger(current_bytes()))
+    .insert(
+      "operations",
+      json::JsonObject().copy(m_usage_object).to_object());
+}
+
+Memory::Usage Memory::record(
+  const char *name,
+  size_t peak_bytes,
+  size_t allocation_count) {
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  Usage usage = m_usage_object.at(name).is_valid()
+                  ? Usage(m_usage_object.at(name).to_object())
+                  : Usage();
+  usage.set_count(usage.get_count() + 1)
+    .set_last_peak_bytes(peak_bytes)
+    .set_last_allocation_count(allocation_count)
+    .set_allocation_count(usage.get_allocation_count() + allocation_count);
+  if (peak_bytes > static_cast<size_t>(usage.get_peak_bytes())) {
+    usage.set_peak_bytes(peak_bytes);
+  }
+  m_usage_object.insert(name, usage);
+  return usage;
+}
+
+#if SERVICE_API_IS_MEMORY_PROFILE
+
+#include <jansson.h>
+
+namespace {
+// keeps the payload aligned for any fundamental type
+constexpr size_t memory_header_size = alignof(std::max_align_t);
+
+void update_peak(std::atomic<size_t> &peak_bytes, size_t current) {
+  size_t peak = peak_bytes.load();
+  while (peak < current && !peak_bytes.compare_exchange_weak(peak, current)) {
+  }
+}
+
+void *memory_allocate(size_t size) {
+  void *block = ::malloc(size + memory_header_size);
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *static_cast<size_t *>(block) = size;
+
+  const size_t current = memory_current_bytes.fetch_add(size) + size;
+  memory_allocation_count++;
+  update_peak(memory_peak_bytes, current);
+  if (memory_operation_active_count.load()) {
+    for (size_t i = 0; i < memory_operation_slot_count; i++) {
+      if (memory_operation_is_active[i].load()) {
+        update_peak(memory_operation_peak_bytes[i], current);
+      }
+    }
+  }
+  return static_cast<char *>(block) + memory_header_size;
+}
+
+void memory_free(void *pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  void *block = static_cast<char *>(pointer) - memory_header_size;
+  memory_current_bytes -= *static_cast<size_t *>(block);
+  ::free(block);
+}
+
+void *memory_json_allocate(size_t size) { return memory_allocate(size); }
+void memory_json_free(void *pointer) { memory_free(pointer); }
+
+// jansson calls malloc() directly; route it through the counters
+// before any JSON value exists so every block is freed with the
+// matching function
+struct MemoryJsonHook {
+  MemoryJsonHook() {
+    json_set_alloc_funcs(memory_json_allocate, memory_json_free);
+  }
+};
+MemoryJsonHook memory_json_hook;
+} // namespace
+
+void *operator new(size_t size) {
+  void *result = memory_allocate(size);
+  if (result == nullptr) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return memory_allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return memory_allocate(size);
+}
+
+void operator delete(void *pointer) noexcept { memory_free(pointer); }
+void operator delete[](void *pointer) noexcept { memory_free(pointer); }
+
+void operator delete(void *pointer, size_t) noexcept { memory_free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept {
+  memory_free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+  memory_free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+  memory_free(pointer);
+}
+
+#endif
@@ -0,0 +1,62 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <json.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
+#include "service/Metrics.hpp"
+
+using namespace service;
+
+namespace {
+thread::Mutex &metrics_mutex() {
+  static thread::Mutex mutex;
+  return mutex;
+}
+} // namespace
+
+Metrics::Source::Source(const var::StringView name) : m_metrics_name(name) {
+  Metrics::add_source(this);
+}
+
+Metrics::Source::~Source() { Metrics::remove_source(this); }
+
+json::JsonObject Metrics::get_metrics() {
+  thread::Mutex::Guard mutex_guard(metrics_mutex());
+  json::JsonObject result;
+  for (const Source *source : source_list()) {
+    result.insert(source->metrics_name(), source->get_metrics());
+  }
+  return result;
+}
+
+json::JsonObject Metrics::get_metrics(const var::StringView name) {
+  thread::Mutex::Guard mutex_guard(metrics_mutex());
+  for (const Source *source : source_list()) {
+    if (source->metrics_name().string_view() == name) {
+      return source->get_metrics();
+    }
+  }
+  return json::JsonObject();
+}
+
+void Metrics::add_source(Source *source) {
+  thread::Mutex::Guard mutex_guard(metrics_mutex());
+  source_list().push_back(source);
+}
+
+void Metrics::remove_source(Source *source) {
+  thread::Mutex::Guard mutex_guard(metrics_mutex());
+  auto &list = source_list();
+  for (size_t i = 0; i < list.count(); i++) {
+    if (list.at(i) == source) {
+      list.remove(i);
+      return;
+    }
+  }
+}
+
+var::Vector<Metrics::Source *> &Metrics::source_list() {
+  static var::Vector<Source *> list;
+  return list;
+}
@@ -10,6 +10,7 @@
 
 #include "service/Build.hpp"
 #include "service/Keys.hpp"
+#include "service/Memory.hpp"
 #include "service/Project.hpp"
 
 using namespace service;
@@ -34,6 +35,7 @@ json::JsonArray Project::list() {
 
 Project &Project::save_build(const SaveBuild &options) {
   API_RETURN_VALUE_IF_ERROR(*this);
+  Memory::Operation memory_operation("publish");
 
   API_ASSERT(options.project_path().is_empty() == false);
   // does the current version already exist
@@ -107,7 +109,9 @@ Project &Project::save_build(const SaveBuild &options) {
   // import the build and upload it
   Build build(Build::Construct()
                 .set_project_path(options.project_path())
-                .set_project_id(get_document_id()));
+                .set_project_id(get_document_id())
+                .set_import_cache(true)
+                .set_parallel_import(options.is_parallel_import()));
 
   // add the README if it is available
 
@@ -118,7 +122,7 @@ Project &Project::save_build(const SaveBuild &options) {
     if (is_readme_available) {
       DataFile readme
         = DataFile().write(File(readme_path), Base64Encoder()).move();
-      CLOUD_PRINTER_TRACE("setting readme to " + readme.data().string_view());
+      SERVICE_PRINTER_TRACE("setting readme to " + readme.data().string_view());
       set_readme(readme.data().string_view());
     }
   }
@@ -163,7 +167,7 @@ Project &Project::save_build(const SaveBuild &options) {
       .key("keyId", keys_document.get_document_id())
       .key("publicKey", keys_document.get_public_key());
 
-    auto show_section = [&](const char *name, const Data &data) {
+    auto show_section = [&](const char *name, const View data) {
       printer::Printer::Object po(printer(), name);
       const ViewFile view_file(data);
 
@@ -182,22 +186,33 @@ Project &Project::save_build(const SaveBuild &options) {
 
     for (const auto &image_info : list) {
       printer::Printer::Object po(printer(), image_info.get_name());
-      {
-        const auto data = image_info.get_image_data();
-        show_section("text/data", data);
-      }
+      show_section("text/data", build.get_image_view(image_info.get_name()));
 
       const auto section_list = image_info.get_section_list();
       for (const auto &section : section_list) {
-        const auto data = section.get_image_data();
-        show_section(section.key().cstring(), data);
+        show_section(
+          section.key().cstring(),
+          build.get_section_image_view(image_info.get_name(), section.key()));
       }
     }
 
     API_RETURN_VALUE_IF_ERROR(*this);
   }
 
-  CLOUD_PRINTER_TRACE("Creating and saving the build to the cloud");
+  const Id latest_build_id = existing_project.get_build_id("");
+  if (latest_build_id.is_empty() == false) {
+    // images that match the latest build are not uploaded again
+    api::ErrorScope error_scope;
+    SERVICE_PRINTER_TRACE("checking for images stored by " | latest_build_id.string_view());
+    const Build latest_build(Build::Construct()
+                               .set_project_id(get_document_id())
+                               .set_build_id(latest_build_id));
+    if (is_success()) {
+      build.reuse_storage(latest_build);
+    }
+  }
+
+  SERVICE_PRINTER_TRACE("Creating and saving the build to the cloud");
   build.set_readme(get_readme())
     .set_description(options.change_description())
     .set_version(version.string_view())
@@ -205,6 +220,8 @@ Project &Project::save_build(const SaveBuild &options) {
     .set_permissions(get_permissions())
     .set_key(key.get_key256_string())
     .set_iv(key.get_initialization_vector_string())
+    .set_chunk_storage(options.is_chunk_storage())
+    .set_compressed_storage(options.is_compressed_storage())
     .save();
 
   printer().object("buildUpload", build, printer::Printer::Level::trace);
@@ -214,7 +231,7 @@ Project &Project::save_build(const SaveBuild &options) {
     BuildItem(build.id()).set_version(version.string_view()));
   set_build_list(project_build_list);
 
-  CLOUD_PRINTER_TRACE("Saving the project document");
+  SERVICE_PRINTER_TRACE("Saving the project document");
   save();
 
   printer().object("projectUpload", to_object());
@@ -4,6 +4,7 @@
 #include <fs.hpp>
 #include <var.hpp>
 
+#include "service/Governor.hpp"
 #include "service/Report.hpp"
 
 using namespace service;
@@ -39,6 +40,7 @@ Report &Report::save(const fs::FileObject &content) {
   DocumentAccess<Report>::save();
   API_RETURN_VALUE_IF_ERROR(*this);
 
+  Governor::Request request;
   cloud_service().storage().create_object(get_storage_path(), encrypted_file.seek(0));
   return *this;
 }
@@ -46,12 +48,16 @@ Report &Report::save(const fs::FileObject &content) {
 void Report::download_contents(const fs::FileObject &destination) {
 
   if (get_key().is_empty()) {
+    Governor::Request request;
     cloud_service().storage().get_object(get_storage_path(), destination);
 
   } else {
 
     DataFile encrypted_file;
-    cloud_service().storage().get_object(get_storage_path(), encrypted_file);
+    {
+      Governor::Request request;
+      cloud_service().storage().get_object(get_storage_path(), encrypted_file);
+    }
 
     m_secret_key = Aes::Key(
       Aes::Key::Construct().set_initialization_vector(get_iv()).set_key(
@@ -0,0 +1,264 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#if defined __link
+#include <sys/stat.h>
+#endif
+
+#include <chrono.hpp>
+#include <crypto.hpp>
+#include <fs.hpp>
+#include <json.hpp>
+#include <printer.hpp>
+#include <var.hpp>
+
+#include "service/Governor.hpp"
+#include "service/Session.hpp"
+#include "service/Trace.hpp"
+
+using namespace service;
+
+Session::Session(const Construct &options)
+  : Metrics::Source("session"), m_path(options.path()),
+    m_email(options.email()), m_key(options.key()),
+    m_token_lifetime(options.token_lifetime()),
+    m_is_plaintext(options.is_plaintext()) {
+
+  chrono::ClockTimer startup_timer;
+  startup_timer.start();
+
+  if (m_path.is_empty() == false && restore_from_cache()) {
+    SERVICE_PRINTER_TRACE("credentials restored from " | m_path.string_view());
+  } else if (login(options)) {
+    save();
+  }
+
+  startup_timer.stop();
+  m_startup_time = startup_timer.micro_time();
+
+  printer::Printer::Object po(printer(), "session");
+  printer()
+    .key("origin", origin_name(m_origin))
+    .key(
+      "startup",
+      NumberString(m_startup_time.microseconds() / 1000.0f, "%0.3fms"));
+}
+
+var::StringView Session::origin_name(Origin value) {
+  switch (value) {
+  case Origin::cache:
+    return "cache";
+  case Origin::refresh:
+    return "refresh";
+  case Origin::login:
+    return "login";
+  case Origin::none:
+    break;
+  }
+  return "none";
+}
+
+bool Session::restore_from_cache() {
+  if (FileSystem().exists(m_path) == false) {
+    SERVICE_PRINTER_TRACE("no credential cache at " | m_path.string_view());
+    return false;
+  }
+
+  Cache cache;
+  {
+    api::ErrorScope error_scope;
+    cache = decrypt_cache(JsonDocument().load(File(m_path)).to_object());
+    if (is_error()) {
+      SERVICE_PRINTER_TRACE("failed to load credential cache");
+      return false;
+    }
+  }
+
+  if (
+    m_email.is_empty() == false
+    && cache.get_email() != m_email.string_view()) {
+    SERVICE_PRINTER_TRACE("cached credentials belong to another user");
+    return false;
+  }
+
+  const auto now = DateTime::get_system_time().ctime();
+  if (cache.get_token().is_empty() == false && now < cache.get_expires_at()) {
+    cloud_service().cloud().set_credentials(
+      cloud::Cloud::Credentials()
+        .set_uid(cache.get_uid())
+        .set_token(cache.get_token())
+        .set_refresh_token(cache.get_refresh_token()));
+    m_email = cache.get_email();
+    m_origin = Origin::cache;
+    return true;
+  }
+
+  return refresh_token(cache);
+}
+
+bool Session::refresh_token(const Cache &cache) {
+  if (cache.get_refresh_token().is_empty()) {
+    return false;
+  }
+
+  SERVICE_PRINTER_TRACE("renewing token with the refresh token");
+  api::ErrorScope error_scope;
+  cloud_service().cloud().set_credentials(
+    cloud::Cloud::Credentials()
+      .set_uid(cache.get_uid())
+      .set_refresh_token(cache.get_refresh_token()));
+
+  {
+    Governor::Request request;
+    cloud_service().cloud().refresh_login();
+  }
+
+  if (is_error()) {
+    SERVICE_PRINTER_TRACE("failed to renew token");
+    return false;
+  }
+
+  m_email = cache.get_email();
+  m_origin = Origin::refresh;
+  save();
+  return true;
+}
+
+bool Session::login(const Construct &options) {
+  if (options.email().is_empty() || options.password().is_empty()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      false,
+      "credentials are not cached, email and password are required",
+      EINVAL);
+  }
+
+  {
+    Governor::Request request;
+    cloud_service().cloud().login(options.email(), options.password());
+  }
+  API_RETURN_VALUE_IF_ERROR(false);
+  m_origin = Origin::login;
+  return true;
+}
+
+Session &Session::save() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_path.is_empty()) {
+    return *this;
+  }
+
+  if (is_encrypted() == false && m_is_plaintext == false) {
+    printer().warning(
+      "credentials are not cached: no key to encrypt the tokens");
+    return *this;
+  }
+
+  const auto &credentials = cloud_service().cloud().credentials();
+  const Cache cache
+    = Cache()
+        .set_uid(credentials.get_uid())
+        .set_email(m_email)
+        .set_expires_at(
+          DateTime::get_system_time().ctime() + m_token_lifetime.seconds())
+        .set_token(credentials.get_token())
+        .set_refresh_token(credentials.get_refresh_token());
+
+  if (is_encrypted() == false) {
+    printer().warning("credential tokens are cached without encryption");
+  }
+
+  // the cache is only readable by the owner, the permissions are only
+  // applied when the file is created
+#if defined __link
+  if (FileSystem().exists(m_path)) {
+    ::chmod(m_path.cstring(), 0600);
+  }
+#endif
+  JsonDocument().save(
+    encrypt_cache(cache),
+    File(
+      File::IsOverwrite::yes,
+      m_path,
+      OpenMode::read_write(),
+      Permissions(0600)));
+
+  return *this;
+}
+
+Session &Session::remove() {
+  if (m_path.is_empty() == false && FileSystem().exists(m_path)) {
+    FileSystem().remove(m_path);
+  }
+  m_origin = Origin::none;
+  return *this;
+}
+
+json::JsonObject Session::get_metrics() const {
+  return JsonObject()
+    .insert("origin", JsonString(origin_name(m_origin)))
+    .insert("startupUs", JsonInteger(m_startup_time.microseconds()));
+}
+
+Session::Cache Session::encrypt_cache(const Cache &cache) const {
+  if (is_encrypted() == false) {
+    return cache;
+  }
+
+  // a fresh initialization vector each time the cache is written
+  const Aes::Key key(Aes::Key::Construct().set_key(m_key).set_initialization_vector(
+    Aes::Key().get_initialization_vector_string()));
+
+  var::String tokens
+    = JsonDocument()
+        .set_flags(JsonDocument::Flags::compact)
+        .stringify(
+          JsonObject()
+            .insert("token", JsonString(cache.get_token()))
+            .insert("refreshToken", JsonString(cache.get_refresh_token())));
+  tokens += (String("\n") * Aes::get_padding(tokens.length()));
+
+  DataFile encrypted_file
+    = DataFile()
+        .write(
+          ViewFile(tokens),
+          AesCbcEncrypter()
+            .set_key256(key.key256())
+            .set_initialization_vector(key.initialization_vector()))
+        .move();
+
+  Cache result = JsonObject().copy(cache).to_object();
+  result.to_object().remove("token").remove("refreshToken");
+  return result.set_iv(key.get_initialization_vector_string())
+    .set_blob(Base64().encode(encrypted_file.data()));
+}
+
+Session::Cache Session::decrypt_cache(const Cache &cache) const {
+  if (cache.get_blob().is_empty()) {
+    return cache;
+  }
+
+  if (is_encrypted() == false) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      cache,
+      "credential cache is encrypted, a key is required",
+      EINVAL);
+  }
+
+  const Aes::Key key(
+    Aes::Key::Construct().set_key(m_key).set_initialization_vector(
+      cache.get_iv()));
+  const Data cipher_data = Base64().decode(cache.get_blob());
+
+  const JsonObject tokens = JsonDocument().load(
+    DataFile()
+      .reserve(cipher_data.size())
+      .write(
+        ViewFile(cipher_data),
+        AesCbcDecrypter()
+          .set_key256(key.key256())
+          .set_initialization_vector(key.initialization_vector()))
+      .seek(0));
+
+  Cache result = JsonObject().copy(cache).to_object();
+  return result.set_token(tokens.at("token").to_string_view())
+    .set_refresh_token(tokens.at("refreshToken").to_string_view());
+}
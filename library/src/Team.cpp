@@ -1,7 +1,220 @@
 // Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
 
+#include <chrono.hpp>
+#include <json.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
 #include "service/Team.hpp"
 
 using namespace service;
 
+namespace {
+class UserCacheEntry {
+public:
+  UserCacheEntry(
+    const var::StringView session,
+    const Team::User &user,
+    u32 timestamp)
+    : m_session(session), m_user(user), m_timestamp(timestamp) {}
+
+  const Team::User &user() const { return m_user; }
+  u32 timestamp() const { return m_timestamp; }
+
+  bool is_match(
+    const var::StringView session,
+    const var::StringView team,
+    const var::StringView uid) const {
+    return (session.is_empty() || m_session.string_view() == session)
+           && (team.is_empty() || m_user.team().string_view() == team)
+           && (uid.is_empty() || m_user.id().string_view() == uid);
+  }
+
+private:
+  var::KeyString m_session;
+  Team::User m_user;
+  u32 m_timestamp;
+};
+
+class UserCache {
+public:
+  UserCache() { m_clock.start(); }
+
+  thread::Mutex mutex;
+  var::Vector<UserCacheEntry> entry_list;
+  u32 lifetime_ms = 60000;
+  // incremented by each invalidation, a lookup that started before
+  // an invalidation doesn't store its result
+  u32 generation = 0;
+
+  static constexpr size_t maximum_count = 256;
+
+  u32 now() const { return m_clock.milliseconds(); }
+
+  // call with the mutex held
+  size_t find(
+    const var::StringView session,
+    const var::StringView team,
+    const var::StringView uid) {
+    const u32 now_ms = now();
+    for (size_t i = 0; i < entry_list.count(); i++) {
+      const auto &entry = entry_list.at(i);
+      if (entry.is_match(session, team, uid)) {
+        if (now_ms - entry.timestamp() < lifetime_ms) {
+          return i;
+        }
+        entry_list.remove(i);
+        break;
+      }
+    }
+    return entry_list.count();
+  }
+
+  // call with the mutex held
+  void insert(
+    const var::StringView session,
+    const Team::User &user,
+    u32 lookup_generation) {
+    if (lookup_generation != generation) {
+      return;
+    }
+    // the oldest entries are at the front
+    while (entry_list.count() >= maximum_count) {
+      entry_list.remove(0);
+    }
+    entry_list.push_back(UserCacheEntry(session, user, now()));
+  }
+
+private:
+  chrono::ClockTimer m_clock;
+};
+
+UserCache &user_cache() {
+  static UserCache value;
+  return value;
+}
+
+Team::User copy_user(const Team::User &user) {
+  // callers may modify the result without touching the cache
+  Team::User result(user);
+  result.to_object() = json::JsonObject().copy(user.to_object()).to_object();
+  return result;
+}
+
+var::KeyString get_session() {
+  // entries belong to the signed in user, a document without an id
+  // doesn't read anything
+  return var::KeyString(
+    Team().cloud_service().store().credentials().get_uid_cstring());
+}
+
+bool is_not_found(Team::User &user) {
+  const json::JsonObject error
+    = json::JsonDocument()
+        .from_string(user.cloud_service().store().error_string())
+        .to_object();
+  return error.at("error").to_object().at("status").to_string_view()
+         == "NOT_FOUND";
+}
+} // namespace
+
 Team::Team(const Id &id) : DocumentAccess("teams", id) {}
+
+void Team::User::interface_save() {
+  DocumentAccess<User>::interface_save();
+  invalidate_user(team(), id());
+}
+
+void Team::User::interface_remove() {
+  DocumentAccess<User>::interface_remove();
+  invalidate_user(team(), id());
+}
+
+void Team::User::interface_save_if_unchanged() {
+  DocumentAccess<User>::interface_save_if_unchanged();
+  invalidate_user(team(), id());
+}
+
+Team::User Team::get_user(const Id &team, const Id &uid) {
+  const var::KeyString session = get_session();
+  auto &cache = user_cache();
+  u32 generation = 0;
+  {
+    thread::Mutex::Guard mutex_guard(cache.mutex);
+    const size_t offset = cache.find(session, team, uid);
+    if (offset < cache.entry_list.count()) {
+      return copy_user(cache.entry_list.at(offset).user());
+    }
+    generation = cache.generation;
+  }
+
+  // the lock is not held during the request
+  User user(team, uid);
+  if (user.is_existing() == false && is_not_found(user) == false) {
+    // the document constructor hides the error, a failed read is
+    // not the same as a user who isn't on the team
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      user,
+      (Path("teams") / team / "users" / uid).cstring(),
+      EIO);
+  }
+
+  thread::Mutex::Guard mutex_guard(cache.mutex);
+  cache.insert(session, copy_user(user), generation);
+  return user;
+}
+
+var::Vector<Team::User>
+Team::get_user_list(const var::Vector<Id> &team_list, const Id &uid) {
+  const var::KeyString session = get_session();
+  auto &cache = user_cache();
+
+  // one pass over the cache resolves every team that is cached
+  var::Vector<User> result;
+  var::Vector<size_t> miss_list;
+  result.reserve(team_list.count());
+  {
+    thread::Mutex::Guard mutex_guard(cache.mutex);
+    for (size_t i = 0; i < team_list.count(); i++) {
+      const size_t offset = cache.find(session, team_list.at(i), uid);
+      if (offset < cache.entry_list.count()) {
+        result.push_back(copy_user(cache.entry_list.at(offset).user()));
+      } else {
+        result.push_back(User(team_list.at(i)));
+        miss_list.push_back(i);
+      }
+    }
+  }
+
+  // each distinct missing team is read once
+  for (size_t i = 0; i < miss_list.count(); i++) {
+    const size_t index = miss_list.at(i);
+    size_t first = index;
+    for (size_t j = 0; j < i; j++) {
+      if (team_list.at(miss_list.at(j)) == team_list.at(index)) {
+        first = miss_list.at(j);
+        break;
+      }
+    }
+    result.at(index) = first == index ? get_user(team_list.at(index), uid)
+                                      : copy_user(result.at(first));
+  }
+  return result;
+}
+
+void Team::invalidate_user(const Id &team, const Id &uid) {
+  auto &cache = user_cache();
+  thread::Mutex::Guard mutex_guard(cache.mutex);
+  cache.generation++;
+  for (size_t i = cache.entry_list.count(); i > 0; i--) {
+    if (cache.entry_list.at(i - 1).is_match(var::StringView(), team, uid)) {
+      cache.entry_list.remove(i - 1);
+    }
+  }
+}
+
+void Team::set_user_cache_lifetime(const chrono::MicroTime &lifetime) {
+  auto &cache = user_cache();
+  thread::Mutex::Guard mutex_guard(cache.mutex);
+  cache.lifetime_ms = lifetime.milliseconds();
+}
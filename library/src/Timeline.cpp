@@ -0,0 +1,111 @@
+// Copyright 2016-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <pthread.h>
+
+#include <chrono.hpp>
+#include <fs.hpp>
+#include <json.hpp>
+#include <thread.hpp>
+#include <var.hpp>
+
+#include "service/Timeline.hpp"
+
+using namespace service;
+
+std::atomic<bool> Timeline::m_is_recording(false);
+
+Timeline::Span::Span(const char *name, const char *category)
+  : m_name(name), m_category(category), m_is_recording(is_recording()) {
+  if (m_is_recording) {
+    m_start = get_timestamp();
+  }
+}
+
+Timeline::Span::~Span() {
+  if (m_is_recording && is_recording()) {
+    const u64 now = get_timestamp();
+    add_event(Event()
+                .set_name(m_name)
+                .set_category(m_category)
+                .set_start(m_start)
+                .set_duration(now - m_start)
+                .set_thread_id(get_thread_id()));
+  }
+}
+
+void Timeline::start() {
+  thread::Mutex::Guard mutex_guard(mutex());
+  event_list().clear();
+  origin() = get_timestamp();
+  m_is_recording = true;
+}
+
+void Timeline::stop(const fs::FileObject &file) {
+  m_is_recording = false;
+  JsonDocument().save(to_object(), file);
+}
+
+json::JsonObject Timeline::to_object() {
+  thread::Mutex::Guard mutex_guard(mutex());
+  json::JsonArray event_array;
+  for (const Event &event : event_list()) {
+    // complete events ("X") carry their own duration
+    event_array.append(json::JsonObject()
+                         .insert("name", json::JsonString(event.name()))
+                         .insert("cat", json::JsonString(event.category()))
+                         .insert("ph", json::JsonString("X"))
+                         .insert(
+                           "ts",
+                           // a span can begin before a restart
+                           json::JsonInteger(
+                             event.start() > origin()
+                               ? event.start() - origin()
+                               : 0))
+                         .insert("dur", json::JsonInteger(event.duration()))
+                         .insert("pid", json::JsonInteger(1))
+                         .insert("tid", json::JsonInteger(event.thread_id())));
+  }
+  return json::JsonObject()
+    .insert("traceEvents", event_array)
+    .insert("displayTimeUnit", json::JsonString("ms"));
+}
+
+thread::Mutex &Timeline::mutex() {
+  static thread::Mutex value;
+  return value;
+}
+
+u64 &Timeline::origin() {
+  static u64 value = 0;
+  return value;
+}
+
+u64 Timeline::get_timestamp() {
+  const auto now = chrono::ClockTime::get_system_time(
+    chrono::ClockTime::ClockId::monotonic);
+  return u64(now.seconds()) * 1000000ULL + u64(now.nanoseconds()) / 1000ULL;
+}
+
+var::Vector<Timeline::Event> &Timeline::event_list() {
+  static var::Vector<Event> value;
+  return value;
+}
+
+u32 Timeline::get_thread_id() {
+  // small sequential ids are easier to read in the viewer than pthread_t
+  static var::Vector<pthread_t> thread_list;
+  const pthread_t self = pthread_self();
+  thread::Mutex::Guard mutex_guard(mutex());
+  for (u32 i = 0; i < thread_list.count(); i++) {
+    if (pthread_equal(thread_list.at(i), self)) {
+      return i + 1;
+    }
+  }
+  thread_list.push_back(self);
+  return thread_list.count();
+}
+
+void Timeline::add_event(const Event &event) {
+  thread::Mutex::Guard mutex_guard(mutex());
+  event_list().push_back(event);
+}